@@ -1,6 +1,9 @@
 // @Author Lin Ya
 // @Email xxbbb@vip.qq.com
 #include "Server.h"
+#include <errno.h>
+#include <fcntl.h>
+#include "net/HttpData.h"
 
 
 Server::Server(EventLoop *loop, int threadNum, int port)
@@ -10,25 +13,52 @@ Server::Server(EventLoop *loop, int threadNum, int port)
       started_(false),
       acceptChannel_(new Channel(loop_)),
       port_(port),
-      listenFd_(socket_bind_listen(port_)) {
+      listenFd_(socket_bind_listen(port_)),
+      idleFd_(open("/dev/null", O_RDONLY | O_CLOEXEC)),
+      computeThreads_(kDefaultComputeThreads),
+      computePool_("ComputePool"),
+      cacheStatsThread_(&Server::logCacheStats, "CacheStats") {
   acceptChannel_->setfd(listenFd_);
   handle_for_sigpipe(); //设置SIGPIPE信号的回调函数
   if (setSocketNonBlocking(listenFd_) < 0) {
     perror("set socket non block failed");
     abort();
   }
+  computePool_.setMaxQueueSize(kDefaultComputeQueueSize);
+  HttpData::registerRoutes(router_, computePool_);
 }
 
 void Server::start() {
+  // 路由表编译后只读，各IO线程共享
+  router_.compile();
   eventLoopThreadPool_->start();
+  computePool_.start(computeThreads_);
   // acceptChannel_->setEvents(EPOLLIN | EPOLLET | EPOLLONESHOT);
   acceptChannel_->setEvents(EPOLLIN | EPOLLET);
   acceptChannel_->setReadHandler(bind(&Server::handNewConn, this));
   acceptChannel_->setConnHandler(bind(&Server::handThisConn, this));
   loop_->addToPoller(acceptChannel_, 0);
+  // 静态文件缓存的inotify通知由主线程的loop处理
+  FileCache::instance().watchInLoop(loop_);
+  cacheStatsThread_.start();
   started_ = true;
 }
 
+// 后台线程：每kCacheStatsInterval秒把响应缓存的统计写一次日志，期间没有新的查找就不写
+void Server::logCacheStats() {
+  uint64_t lastLookups = 0;
+  while (true) {
+    sleep(kCacheStatsInterval);
+    ResponseCache::Stats s = ResponseCache::instance().stats();
+    uint64_t lookups = s.hits + s.misses;
+    if (lookups == lastLookups) continue;
+    lastLookups = lookups;
+    LOG << "ResponseCache: hits " << s.hits << ", misses " << s.misses << ", insertions "
+        << s.insertions << ", evictions " << s.evictions << ", invalidations "
+        << s.invalidations << ", entries " << s.entries << ", bytes " << s.bytes;
+  }
+}
+
 void Server::handNewConn() {
   struct sockaddr_in client_addr;
   memset(&client_addr, 0, sizeof(struct sockaddr_in));
@@ -49,11 +79,6 @@ void Server::handNewConn() {
     getsockopt(accept_fd, SOL_SOCKET,  SO_KEEPALIVE, &optval, &len_optval);
     cout << "optval ==" << optval << endl;
     */
-    // 限制服务器的最大并发连接数
-    if (accept_fd >= MAXFDS) {
-      close(accept_fd);
-      continue;
-    }
     // 设为非阻塞模式
     if (setSocketNonBlocking(accept_fd) < 0) {
       LOG << "Set non block failed!";
@@ -64,9 +89,20 @@ void Server::handNewConn() {
     setSocketNodelay(accept_fd);
     // setSocketNoLinger(accept_fd);
 
-    shared_ptr<HttpData> req_info(new HttpData(loop, accept_fd));
-    req_info->getChannel()->setHolder(req_info);
-    loop->queueInLoop(std::bind(&HttpData::newEvent, req_info));
+    // 连接对象在所属loop的线程里从它的空闲链表取
+    const Router *router = &router_;
+    loop->queueInLoop([loop, accept_fd, router]() {
+      HttpData::create(loop, accept_fd, router)->newEvent();
+    });
+  }
+  // fd用完时连接留在监听队列里，边沿触发下不会再通知；腾出预留的fd把排队的连接逐个接受并关掉，让对端知道
+  while (errno == EMFILE && idleFd_ >= 0) {
+    close(idleFd_);
+    int dropped = accept(listenFd_, NULL, NULL);
+    if (dropped >= 0) close(dropped);
+    idleFd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (dropped < 0) break;
+    LOG << "Too many open files, connection dropped";
   }
   acceptChannel_->setEvents(EPOLLIN | EPOLLET);
 }
\ No newline at end of file
@@ -8,18 +8,32 @@
 #include <functional>
 #include "net/Util.h"
 #include "base/Logging.h"
+#include "base/ThreadPool.h"
 #include "net/Channel.h"
 #include "net/EventLoop.h"
 #include "net/EventLoopThreadPool.h"
+#include "net/FileCache.h"
+#include "net/ResponseCache.h"
+#include "base/Thread.h"
+#include "net/Router.h"
 
 class Server {
  public:
   Server(EventLoop *loop, int threadNum, int port);
   ~Server() {}
+  // 每隔多久把响应缓存的命中统计写进日志(秒)
+  static const int kCacheStatsInterval = 60;
+  static const int kDefaultComputeThreads = 2;
+  static const size_t kDefaultComputeQueueSize = 64;
   EventLoop *getLoop() const { return loop_; }
   void start();
   void handNewConn();
   void handThisConn() { loop_->updatePoller(acceptChannel_); }
+  // start之前可以在这里注册更多的路由
+  Router &router() { return router_; }
+  // 耗CPU的处理函数用的计算线程池，线程数和队列上限在start之前设置
+  void setComputeThreads(int n) { computeThreads_ = n; }
+  ThreadPool &computePool() { return computePool_; }
 
  private:
   EventLoop *loop_;
@@ -29,5 +43,11 @@ class Server {
   std::shared_ptr<Channel> acceptChannel_;
   int port_;
   int listenFd_;
-  static const int MAXFDS = 100000;
+  int idleFd_;  // 预留的fd，fd耗尽时用来接受并关闭连接
+  Router router_;
+  int computeThreads_;
+  ThreadPool computePool_;
+  Thread cacheStatsThread_;  // 定期把响应缓存的统计写进日志
+
+  static void logCacheStats();
 };
\ No newline at end of file
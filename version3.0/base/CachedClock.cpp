@@ -0,0 +1,60 @@
+#include "CachedClock.h"
+#include <stdio.h>
+
+namespace CachedClock {
+    __thread bool t_updated = false;   // 本线程是否在运行EventLoop
+    __thread int64_t t_monotonicMs = 0;
+    __thread time_t t_wallSeconds = 0;
+
+    __thread time_t t_httpDateSeconds = -1; // t_httpDate对应的秒数
+    __thread char t_httpDate[32];
+    __thread size_t t_httpDateLen = 0;
+    __thread time_t t_logSeconds = -1;
+    __thread char t_logTimestamp[32];
+    __thread size_t t_logTimestampLen = 0;
+
+    int64_t readMonotonicMs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    // 秒级的精度就够了，COARSE时钟不需要读硬件计数器
+    time_t readWallSeconds() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        return ts.tv_sec;
+    }
+
+    void update() {
+        t_updated = true;
+        t_monotonicMs = readMonotonicMs();
+        t_wallSeconds = readWallSeconds();
+    }
+
+    int64_t nowMs() { return t_updated ? t_monotonicMs : readMonotonicMs(); }
+
+    time_t wallSeconds() { return t_updated ? t_wallSeconds : readWallSeconds(); }
+
+    StringPiece httpDate() {
+        time_t now = wallSeconds();
+        if (now != t_httpDateSeconds) {
+            struct tm tm_time;
+            gmtime_r(&now, &tm_time);
+            t_httpDateLen = strftime(t_httpDate, sizeof t_httpDate, "%a, %d %b %Y %H:%M:%S GMT", &tm_time);
+            t_httpDateSeconds = now;
+        }
+        return StringPiece(t_httpDate, t_httpDateLen);
+    }
+
+    StringPiece logTimestamp() {
+        time_t now = wallSeconds();
+        if (now != t_logSeconds) {
+            struct tm tm_time;
+            localtime_r(&now, &tm_time);
+            t_logTimestampLen = strftime(t_logTimestamp, sizeof t_logTimestamp, "%Y-%m-%d %H:%M:%S\n", &tm_time);
+            t_logSeconds = now;
+        }
+        return StringPiece(t_logTimestamp, t_logTimestampLen);
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+#include "StringPiece.h"
+
+// 按线程缓存的时间：EventLoop每轮循环(epoll_wait返回后)调用一次update()，读一次单调时钟和一次
+// 墙上时钟，这一轮里的定时器、HTTP响应和日志都直接用缓存的值，不再各自调用gettimeofday；
+// 格式化好的Date头部和日志时间戳每秒最多重新生成一次
+// 没有运行EventLoop的线程(日志线程、压缩线程等)没有调用过update()，每次都直接读时钟
+namespace CachedClock {
+    // 在EventLoop线程中每轮循环调用一次
+    void update();
+
+    // 单调时钟，毫秒，用于定时器
+    int64_t nowMs();
+    // 墙上时钟，秒
+    time_t wallSeconds();
+
+    // RFC 7231格式的当前时间，例如"Sun, 06 Nov 1994 08:49:37 GMT"，用于Date头部
+    StringPiece httpDate();
+    // 日志时间戳前缀，本地时间，例如"2018-04-01 12:00:00\n"
+    StringPiece logTimestamp();
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stddef.h>
+#include <memory>
+#include <vector>
+#include "noncopyable.h"
+
+// 以fd为下标的表：按页(4096项)在第一次写入时才分配，没用到的fd段不占内存；
+// 页目录按预计的fd上限预留，fd超出时自动扩展，所以没有写死的上限
+template <typename T>
+class FdTable : noncopyable {
+public:
+    explicit FdTable(size_t maxFds = 0) : pages_((maxFds + kPageSize - 1) >> kPageShift) {}
+
+    // fd所在的页还没分配时返回NULL，不分配
+    T *find(int fd) {
+        size_t page = static_cast<size_t>(fd) >> kPageShift;
+        if (page >= pages_.size() || !pages_[page]) return NULL;
+        return &pages_[page][fd & (kPageSize - 1)];
+    }
+
+    // 需要时分配fd所在的页
+    T &operator[](int fd) {
+        size_t page = static_cast<size_t>(fd) >> kPageShift;
+        if (page >= pages_.size()) pages_.resize(page + 1);
+        if (!pages_[page]) pages_[page].reset(new T[kPageSize]());
+        return pages_[page][fd & (kPageSize - 1)];
+    }
+
+    // 已经分配的页数，用于统计内存
+    size_t allocatedPages() const {
+        size_t n = 0;
+        for (size_t i = 0; i < pages_.size(); ++i)
+            if (pages_[i]) ++n;
+        return n;
+    }
+
+private:
+    static const int kPageShift = 12;
+    static const size_t kPageSize = static_cast<size_t>(1) << kPageShift;
+
+    std::vector<std::unique_ptr<T[]>> pages_;
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <utility>
+
+// 侵入式引用计数的智能指针：计数放在对象自己身上(T提供retain/release)，
+// 不像shared_ptr那样另外分配控制块，也没有weak_ptr的第二个计数；
+// 计数归零时怎么处理由T::release决定，比如放回对象池
+template <typename T>
+class IntrusivePtr {
+public:
+    IntrusivePtr() : p_(NULL) {}
+    explicit IntrusivePtr(T *p) : p_(p) {
+        if (p_) p_->retain();
+    }
+    IntrusivePtr(const IntrusivePtr &other) : p_(other.p_) {
+        if (p_) p_->retain();
+    }
+    IntrusivePtr(IntrusivePtr &&other) noexcept : p_(other.p_) { other.p_ = NULL; }
+    ~IntrusivePtr() {
+        if (p_) p_->release();
+    }
+
+    IntrusivePtr &operator=(IntrusivePtr other) noexcept {
+        swap(other);
+        return *this;
+    }
+    void swap(IntrusivePtr &other) noexcept { std::swap(p_, other.p_); }
+    void reset() { IntrusivePtr().swap(*this); }
+
+    T *get() const { return p_; }
+    T &operator*() const { return *p_; }
+    T *operator->() const { return p_; }
+    explicit operator bool() const { return p_ != NULL; }
+
+private:
+    T *p_;
+};
@@ -4,10 +4,9 @@
 #include "CurrentThread.h"
 #include "Thread.h"
 #include "AsyncLogging.h"
+#include "CachedClock.h"
 #include <assert.h>
 #include <iostream>
-#include <time.h>  
-#include <sys/time.h> 
 
 
 static pthread_once_t once_control_ = PTHREAD_ONCE_INIT;
@@ -37,14 +36,9 @@ Logger::Impl::Impl(const char *fileName, int line)
 
 void Logger::Impl::formatTime()
 {
-    struct timeval tv;
-    time_t time;
-    char str_t[26] = {0};
-    gettimeofday (&tv, NULL);
-    time = tv.tv_sec;
-    struct tm* p_time = localtime(&time);   
-    strftime(str_t, 26, "%Y-%m-%d %H:%M:%S\n", p_time);
-    stream_ << str_t;
+    // 时间戳由CachedClock按线程缓存，每秒最多格式化一次
+    StringPiece timestamp = CachedClock::logTimestamp();
+    stream_.append(timestamp.data(), static_cast<int>(timestamp.size()));
 }
 
 Logger::Logger(const char *fileName, int line)
@@ -0,0 +1,53 @@
+#pragma once
+#include <string.h>
+#include <strings.h>
+#include <string>
+
+// 仿照muduo的StringPiece：只记录指针和长度的只读字符串视图，不拥有数据，不拷贝
+// (相当于C++17的std::string_view)；指向的数据由使用者保证在使用期间有效
+class StringPiece {
+public:
+    StringPiece() : ptr_(NULL), length_(0) {}
+    StringPiece(const char *str) : ptr_(str), length_(strlen(str)) {}
+    StringPiece(const std::string &str) : ptr_(str.data()), length_(str.size()) {}
+    StringPiece(const char *offset, size_t len) : ptr_(offset), length_(len) {}
+
+    const char *data() const { return ptr_; }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    const char *begin() const { return ptr_; }
+    const char *end() const { return ptr_ + length_; }
+    char operator[](size_t i) const { return ptr_[i]; }
+
+    void clear() {
+        ptr_ = NULL;
+        length_ = 0;
+    }
+    void set(const char *data, size_t len) {
+        ptr_ = data;
+        length_ = len;
+    }
+    void remove_prefix(size_t n) {
+        ptr_ += n;
+        length_ -= n;
+    }
+    void remove_suffix(size_t n) { length_ -= n; }
+
+    bool operator==(const StringPiece &x) const {
+        return length_ == x.length_ && memcmp(ptr_, x.ptr_, length_) == 0;
+    }
+    bool operator!=(const StringPiece &x) const { return !(*this == x); }
+    // ASCII大小写不敏感的比较，HTTP头部名字和很多头部值都要这样比
+    bool equalsIgnoreCase(const StringPiece &x) const {
+        return length_ == x.length_ && strncasecmp(ptr_, x.ptr_, length_) == 0;
+    }
+    bool starts_with(const StringPiece &x) const {
+        return length_ >= x.length_ && memcmp(ptr_, x.ptr_, x.length_) == 0;
+    }
+
+    std::string as_string() const { return std::string(ptr_, length_); }
+
+private:
+    const char *ptr_;
+    size_t length_;
+};
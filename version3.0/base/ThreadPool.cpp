@@ -0,0 +1,62 @@
+#include "ThreadPool.h"
+#include <assert.h>
+
+ThreadPool::ThreadPool(const std::string &name)
+    : mutex_(), notEmpty_(mutex_), name_(name), maxQueueSize_(0), running_(false) {}
+
+ThreadPool::~ThreadPool() {
+    if (running_) stop();
+}
+
+void ThreadPool::start(int numThreads) {
+    assert(threads_.empty());
+    running_ = true;
+    threads_.reserve(numThreads);
+    for (int i = 0; i < numThreads; ++i) {
+        threads_.emplace_back(
+            new Thread(std::bind(&ThreadPool::runInThread, this), name_ + std::to_string(i)));
+        threads_[i]->start();
+    }
+}
+
+void ThreadPool::stop() {
+    {
+        MutexLockGuard lock(mutex_);
+        running_ = false;
+        queue_.clear();
+        notEmpty_.broadcast();
+    }
+    for (size_t i = 0; i < threads_.size(); ++i) threads_[i]->join();
+}
+
+bool ThreadPool::trySubmit(const Task &task) {
+    if (threads_.empty()) {
+        if (!running_) return false;
+        task();
+        return true;
+    }
+    MutexLockGuard lock(mutex_);
+    if (!running_ || (maxQueueSize_ > 0 && queue_.size() >= maxQueueSize_)) return false;
+    queue_.push_back(task);
+    notEmpty_.signal();
+    return true;
+}
+
+size_t ThreadPool::queueSize() const {
+    MutexLockGuard lock(mutex_);
+    return queue_.size();
+}
+
+void ThreadPool::runInThread() {
+    while (true) {
+        Task task;
+        {
+            MutexLockGuard lock(mutex_);
+            while (queue_.empty() && running_) notEmpty_.wait();
+            if (!running_) break;
+            task = queue_.front();
+            queue_.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Condition.h"
+#include "MutexLock.h"
+#include "Thread.h"
+#include "noncopyable.h"
+
+// 计算线程池：耗CPU的处理(图像处理、压缩等)放到这里做，不占用IO线程。
+// 队列有上限，满了trySubmit直接失败，由调用者决定怎么拒绝(HTTP里回503)，
+// 过载时不会无限排队，排在后面的请求也不会等到超时
+class ThreadPool : noncopyable {
+public:
+    typedef std::function<void()> Task;
+
+    explicit ThreadPool(const std::string &name = std::string("ThreadPool"));
+    ~ThreadPool();
+
+    // 排队(还没开始执行)的任务数上限，0表示不限；start之前设置
+    void setMaxQueueSize(size_t maxSize) { maxQueueSize_ = maxSize; }
+    // numThreads为0时不创建线程，任务在调用trySubmit的线程里直接执行
+    void start(int numThreads);
+    // 不再接受新任务，已经排队的任务丢弃，等正在执行的任务结束
+    void stop();
+
+    // 队列已满或者已经stop时返回false，task不会执行
+    bool trySubmit(const Task &task);
+
+    size_t queueSize() const;
+    const std::string &name() const { return name_; }
+
+private:
+    void runInThread();
+
+    mutable MutexLock mutex_;
+    Condition notEmpty_;
+    std::string name_;
+    std::vector<std::unique_ptr<Thread>> threads_;
+    std::deque<Task> queue_;
+    size_t maxQueueSize_;
+    bool running_;
+};
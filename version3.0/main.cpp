@@ -3,6 +3,9 @@
 #include "net/EventLoop.h"
 #include "Server.h"
 #include "base/Logging.h"
+#include "net/HttpData.h"
+#include "net/HttpScanner.h"
+#include "net/ResponseCache.h"
 
 using namespace std;
 
@@ -10,10 +13,16 @@ int main(int argc, char *argv[]) {
     int threadNum = 4;
     int port = 10000;
     string logPath = "./WebServer.log";
+    int cacheMB = ResponseCache::kDefaultCapacity >> 20;
+    int pipelineDepth = HttpData::kDefaultMaxPipelinedRequests;
+    bool uploads = false;
+    int computeThreads = Server::kDefaultComputeThreads;
+    int computeQueue = static_cast<int>(Server::kDefaultComputeQueueSize);
+    int maxFds = 0;
 
     // parse args
     int opt;
-    const char *str = "t:l:p";
+    const char *str = "t:l:p:c:d:wk:q:n:";
     while ((opt = getopt(argc, argv, str)) != -1)  {
         switch (opt)
         {
@@ -33,17 +42,58 @@ int main(int argc, char *argv[]) {
             port = atoi(optarg);
             break;
         }
+        case 'c': {
+            cacheMB = atoi(optarg);
+            break;
+        }
+        case 'd': {
+            pipelineDepth = atoi(optarg);
+            break;
+        }
+        case 'w': {
+            uploads = true;
+            break;
+        }
+        case 'k': {
+            computeThreads = atoi(optarg);
+            break;
+        }
+        case 'q': {
+            computeQueue = atoi(optarg);
+            break;
+        }
+        case 'n': {
+            maxFds = atoi(optarg);
+            break;
+        }
         default:
             break;
         }
     }
     Logger::setLogFileName(logPath);
+    // 同时打开的fd数(RLIMIT_NOFILE)决定了最大并发连接数，要在创建EventLoop之前调整
+    if (maxFds > 0) {
+        int limit = raiseOpenFileLimit(maxFds);
+        if (limit < maxFds) printf("RLIMIT_NOFILE limited to %d\n", limit);
+    }
+    LOG << "Max open files: " << getOpenFileLimit();
+    // 热点响应缓存的容量，为0时不缓存
+    ResponseCache::instance().setCapacity(static_cast<size_t>(cacheMB) << 20);
+    // 每个连接上最多同时有多少个管线请求在处理(响应还没发完)
+    HttpData::setMaxPipelinedRequests(pipelineDepth);
+    // 允许PUT上传和DELETE删除网站目录下的文件
+    HttpData::setUploadsEnabled(uploads);
     // STL库再多线程上的应用
     #ifndef _PTHREADS
         LOG << "_PTHREADS is not defined!";
     #endif
+    // 解析请求用的分隔符扫描实现(按CPU支持的指令集选择)
+    LOG << "HTTP scanner: " << httpScannerName();
     EventLoop mainLoop;
     Server myHTTPServer(&mainLoop, threadNum, port);
+    // 计算线程池：线程数(为0时在IO线程里直接算)和排队上限(满了回503，为0时不限)
+    myHTTPServer.setComputeThreads(computeThreads);
+    myHTTPServer.computePool().setMaxQueueSize(computeQueue > 0 ? computeQueue : 0);
     myHTTPServer.start();
     mainLoop.loop();
     return 0;
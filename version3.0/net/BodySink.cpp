@@ -0,0 +1,93 @@
+#include "BodySink.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+bool writeAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// mkstemp需要可写的模板
+int makeTemp(const std::string &prefix, std::string &path) {
+    std::vector<char> name(prefix.begin(), prefix.end());
+    const char suffix[] = "XXXXXX";
+    name.insert(name.end(), suffix, suffix + sizeof suffix);
+    int fd = mkstemp(name.data());
+    if (fd >= 0) path.assign(name.data());
+    return fd;
+}
+
+} // namespace
+
+SpoolBodySink::SpoolBodySink(size_t threshold) : threshold_(threshold), size_(0), fd_(-1) {}
+
+SpoolBodySink::~SpoolBodySink() {
+    if (fd_ >= 0) close(fd_);
+}
+
+const char *SpoolBodySink::spoolDir() {
+    const char *dir = getenv("TMPDIR");
+    return dir && *dir ? dir : "/tmp";
+}
+
+bool SpoolBodySink::write(const char *data, size_t len) {
+    if (fd_ < 0 && size_ + len > threshold_ && !spill()) return false;
+    if (fd_ >= 0) {
+        if (!writeAll(fd_, data, len)) return false;
+    } else {
+        memory_.append(data, len);
+    }
+    size_ += len;
+    return true;
+}
+
+bool SpoolBodySink::spill() {
+    std::string path;
+    fd_ = makeTemp(std::string(spoolDir()) + "/WebServer-body-", path);
+    if (fd_ < 0) return false;
+    unlink(path.c_str());
+    if (!writeAll(fd_, memory_.data(), memory_.size())) return false;
+    std::string().swap(memory_);
+    return true;
+}
+
+FileBodySink::FileBodySink(const std::string &path)
+    : path_(path), fd_(-1), finished_(false), created_(false) {
+    // 和目标文件在同一个目录(同一个文件系统)下，rename才是原子的
+    std::string::size_type slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    fd_ = makeTemp(dir + ".upload-", tmpPath_);
+}
+
+FileBodySink::~FileBodySink() {
+    if (fd_ >= 0) close(fd_);
+    if (!finished_ && !tmpPath_.empty()) unlink(tmpPath_.c_str());
+}
+
+bool FileBodySink::write(const char *data, size_t len) {
+    return fd_ >= 0 && writeAll(fd_, data, len);
+}
+
+bool FileBodySink::finish() {
+    if (fd_ < 0) return false;
+    // mkstemp创建的文件权限是0600，改成和普通静态文件一样
+    fchmod(fd_, 0644);
+    struct stat st;
+    created_ = stat(path_.c_str(), &st) < 0;
+    if (rename(tmpPath_.c_str(), path_.c_str()) < 0) return false;
+    finished_ = true;
+    return true;
+}
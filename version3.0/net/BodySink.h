@@ -0,0 +1,70 @@
+#pragma once
+#include <sys/types.h>
+#include <memory>
+#include <string>
+#include "../base/noncopyable.h"
+
+// 请求体的去处，和BodySource相对：请求体收到一段就交给它一段，交出去的数据随即从输入缓冲区删掉，
+// 所以不管请求体多大，连接本身只占一次read的内存
+class BodySink : noncopyable {
+public:
+    virtual ~BodySink() {}
+    // 追加一段请求体，返回false表示出错(写盘失败等)
+    virtual bool write(const char *data, size_t len) = 0;
+    // 请求体已经全部收到
+    virtual bool finish() { return true; }
+};
+typedef std::shared_ptr<BodySink> SPBodySink;
+
+// 丢弃请求体，用在不需要请求体的请求上，保证连接上后面的请求能正确分界
+class DiscardBodySink : public BodySink {
+public:
+    bool write(const char *, size_t) { return true; }
+};
+
+// 小的请求体放在内存里，超过threshold后连同已经收到的部分一起转存到临时文件
+// 临时文件创建后立即unlink，只通过fd访问，连接断开或进程退出时自动回收
+class SpoolBodySink : public BodySink {
+public:
+    explicit SpoolBodySink(size_t threshold);
+    ~SpoolBodySink();
+    bool write(const char *data, size_t len);
+
+    size_t size() const { return size_; }
+    bool spooled() const { return fd_ >= 0; }
+    // spooled()为false时数据在memory()里，否则在fd()的[0, size())中
+    const std::string &memory() const { return memory_; }
+    int fd() const { return fd_; }
+
+    // 临时文件所在的目录，取环境变量TMPDIR，默认/tmp
+    static const char *spoolDir();
+
+private:
+    bool spill();
+
+    size_t threshold_;
+    size_t size_;
+    std::string memory_;
+    int fd_;
+};
+
+// 直接写进目标文件所在目录下的临时文件，全部收到后rename成目标文件：
+// 替换是原子的，读者看到的要么是旧文件要么是完整的新文件；没有finish就析构时删掉临时文件
+class FileBodySink : public BodySink {
+public:
+    explicit FileBodySink(const std::string &path);
+    ~FileBodySink();
+    // 临时文件没能创建时为false
+    bool valid() const { return fd_ >= 0; }
+    bool write(const char *data, size_t len);
+    bool finish();
+    // finish之前目标文件不存在
+    bool created() const { return created_; }
+
+private:
+    std::string path_;
+    std::string tmpPath_;
+    int fd_;
+    bool finished_;
+    bool created_;
+};
@@ -0,0 +1,25 @@
+#include "BodySource.h"
+#include <errno.h>
+#include <unistd.h>
+#include <algorithm>
+
+FileBodySource::FileBodySource(int fd, off_t offset, size_t len, Anchor anchor)
+    : fd_(fd), offset_(offset), remain_(len), anchor_(std::move(anchor)) {}
+
+FileBodySource::~FileBodySource() {
+    if (!anchor_ && fd_ >= 0) close(fd_);
+}
+
+ssize_t FileBodySource::read(Buffer &buf, size_t maxBytes) {
+    size_t want = std::min(maxBytes, remain_);
+    if (want == 0) return 0;
+    buf.ensureWritableBytes(want);
+    ssize_t n;
+    while ((n = pread(fd_, buf.beginWrite(), want, offset_)) < 0 && errno == EINTR) {}
+    // 读到文件末尾还没读够，说明发送期间文件被截断了
+    if (n <= 0) return -1;
+    buf.hasWritten(n);
+    offset_ += n;
+    remain_ -= n;
+    return n;
+}
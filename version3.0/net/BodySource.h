@@ -0,0 +1,43 @@
+#pragma once
+#include <sys/types.h>
+#include <functional>
+#include <memory>
+#include "Buffer.h"
+#include "../base/noncopyable.h"
+
+// 流式响应体的数据源：输出队列只在socket可写、前面的数据都发完时才向它要下一块，
+// 每次最多要一块(OutputQueue::kSourceChunk)，所以不管响应体多大，每个连接只占一块的内存
+class BodySource : noncopyable {
+public:
+    virtual ~BodySource() {}
+    // 往buf末尾追加不超过maxBytes字节，返回追加的字节数；0表示数据已经全部产生，-1表示出错
+    virtual ssize_t read(Buffer &buf, size_t maxBytes) = 0;
+};
+typedef std::shared_ptr<BodySource> SPBodySource;
+
+// 用pread分块读文件[offset, offset+len)，用在不能sendfile的场合
+class FileBodySource : public BodySource {
+public:
+    typedef std::shared_ptr<const void> Anchor;
+    // anchor为空时由数据源负责关闭fd
+    FileBodySource(int fd, off_t offset, size_t len, Anchor anchor = Anchor());
+    ~FileBodySource();
+    ssize_t read(Buffer &buf, size_t maxBytes);
+
+private:
+    int fd_;
+    off_t offset_;
+    size_t remain_;
+    Anchor anchor_;
+};
+
+// 由回调产生数据，回调的约定同BodySource::read
+class GeneratorBodySource : public BodySource {
+public:
+    typedef std::function<ssize_t(Buffer &, size_t)> Generator;
+    explicit GeneratorBodySource(const Generator &gen) : gen_(gen) {}
+    ssize_t read(Buffer &buf, size_t maxBytes) { return gen_(buf, maxBytes); }
+
+private:
+    Generator gen_;
+};
@@ -0,0 +1,43 @@
+#include "Buffer.h"
+#include <errno.h>
+#include <sys/uio.h>
+
+const char Buffer::kCRLF[] = "\r\n";
+
+const size_t Buffer::kCheapPrepend;
+const size_t Buffer::kInitialSize;
+
+ssize_t Buffer::readFd(int fd, int *savedErrno) {
+    // 栈上的临时空间，缓冲区可写空间不够时由readv写到这里，再append进缓冲区
+    char extrabuf[65536];
+    struct iovec vec[2];
+    const size_t writable = writableBytes();
+    vec[0].iov_base = begin() + writerIndex_;
+    vec[0].iov_len = writable;
+    vec[1].iov_base = extrabuf;
+    vec[1].iov_len = sizeof extrabuf;
+    // 可写空间已经比extrabuf大时就不需要再用extrabuf了
+    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+    const ssize_t n = readv(fd, vec, iovcnt);
+    if (n < 0) {
+        *savedErrno = errno;
+    } else if (static_cast<size_t>(n) <= writable) {
+        writerIndex_ += n;
+    } else {
+        writerIndex_ = buffer_.size();
+        append(extrabuf, n - writable);
+    }
+    return n;
+}
+
+void Buffer::makeSpace(size_t len) {
+    if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
+        buffer_.resize(writerIndex_ + len);
+    } else {
+        // 把可读数据挪到前面，复用已经读走的空间
+        size_t readable = readableBytes();
+        std::copy(begin() + readerIndex_, begin() + writerIndex_, begin() + kCheapPrepend);
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = readerIndex_ + readable;
+    }
+}
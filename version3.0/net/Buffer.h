@@ -0,0 +1,129 @@
+#pragma once
+#include <assert.h>
+#include <string.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// 仿照muduo实现的应用层缓冲区，替代HttpData中的std::string输入输出缓冲
+// 内部是一块连续的vector<char>，由两个下标划分为三个区域：
+//
+// +-------------------+------------------+------------------+
+// | prependable bytes |  readable bytes  |  writable bytes  |
+// |                   |     (CONTENT)    |                  |
+// +-------------------+------------------+------------------+
+// |                   |                  |                  |
+// 0      <=      readerIndex   <=   writerIndex    <=     size
+//
+// - 读走数据(retrieve)只移动readerIndex_，O(1)完成，不像substr那样拷贝剩余数据
+// - 写入数据(append)空间不够时，优先把可读数据挪回头部复用前面已读过的空间，不够再扩容
+// - readFd用readv同时读进缓冲区和栈上64KB的临时空间，一次系统调用尽可能多读，
+//   又不必为每个连接预先分配很大的缓冲区
+
+class Buffer {
+public:
+    static const size_t kCheapPrepend = 8;
+    static const size_t kInitialSize = 1024;
+
+    explicit Buffer(size_t initialSize = kInitialSize)
+        : buffer_(kCheapPrepend + initialSize),
+          readerIndex_(kCheapPrepend),
+          writerIndex_(kCheapPrepend) {}
+
+    size_t readableBytes() const { return writerIndex_ - readerIndex_; }
+    size_t writableBytes() const { return buffer_.size() - writerIndex_; }
+    size_t prependableBytes() const { return readerIndex_; }
+    bool empty() const { return readableBytes() == 0; }
+    size_t internalCapacity() const { return buffer_.capacity(); }
+
+    // 可读数据的起始地址
+    const char *peek() const { return begin() + readerIndex_; }
+
+    const char *findCRLF() const { return findCRLF(peek()); }
+    const char *findCRLF(const char *start) const {
+        assert(peek() <= start);
+        assert(start <= beginWrite());
+        const char *crlf = std::search(start, beginWrite(), kCRLF, kCRLF + 2);
+        return crlf == beginWrite() ? NULL : crlf;
+    }
+
+    // 读走len个字节，只移动下标
+    void retrieve(size_t len) {
+        assert(len <= readableBytes());
+        if (len < readableBytes()) {
+            readerIndex_ += len;
+        } else {
+            retrieveAll();
+        }
+    }
+    void retrieveUntil(const char *end) {
+        assert(peek() <= end);
+        assert(end <= beginWrite());
+        retrieve(end - peek());
+    }
+    void retrieveAll() {
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = kCheapPrepend;
+    }
+    std::string retrieveAsString(size_t len) {
+        assert(len <= readableBytes());
+        std::string result(peek(), len);
+        retrieve(len);
+        return result;
+    }
+    std::string retrieveAllAsString() { return retrieveAsString(readableBytes()); }
+    // 删掉可读数据中[offset, offset + len)这一段，后面的数据前移；删的是末尾时不需要挪动
+    void erase(size_t offset, size_t len) {
+        assert(offset + len <= readableBytes());
+        char *start = begin() + readerIndex_ + offset;
+        std::copy(start + len, begin() + writerIndex_, start);
+        writerIndex_ -= len;
+    }
+    std::string toString() const { return std::string(peek(), readableBytes()); }
+
+    void append(const char *data, size_t len) {
+        ensureWritableBytes(len);
+        std::copy(data, data + len, beginWrite());
+        hasWritten(len);
+    }
+    void append(const void *data, size_t len) { append(static_cast<const char *>(data), len); }
+    void append(const std::string &str) { append(str.data(), str.size()); }
+
+    void ensureWritableBytes(size_t len) {
+        if (writableBytes() < len) makeSpace(len);
+        assert(writableBytes() >= len);
+    }
+    char *beginWrite() { return begin() + writerIndex_; }
+    const char *beginWrite() const { return begin() + writerIndex_; }
+    void hasWritten(size_t len) {
+        assert(len <= writableBytes());
+        writerIndex_ += len;
+    }
+
+    // 释放多余的容量，只保留可读数据和reserve个字节的可写空间
+    void shrink(size_t reserve) {
+        Buffer other(readableBytes() + reserve);
+        other.append(peek(), readableBytes());
+        swap(other);
+    }
+    void swap(Buffer &rhs) {
+        buffer_.swap(rhs.buffer_);
+        std::swap(readerIndex_, rhs.readerIndex_);
+        std::swap(writerIndex_, rhs.writerIndex_);
+    }
+
+    // 从fd上读取数据，返回值同read，出错时savedErrno保存errno
+    ssize_t readFd(int fd, int *savedErrno);
+
+private:
+    char *begin() { return &*buffer_.begin(); }
+    const char *begin() const { return &*buffer_.begin(); }
+    void makeSpace(size_t len);
+
+    std::vector<char> buffer_;
+    size_t readerIndex_;
+    size_t writerIndex_;
+
+    static const char kCRLF[];
+};
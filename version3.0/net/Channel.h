@@ -30,16 +30,19 @@ private:
     CallBack errorHandler_;
     CallBack connHandler_;
 public:
-    Channel(EventLoop *loop) : loop_(loop), fd_(0), events_(0), lastEvents_(0) {}
-    Channel(EventLoop *loop, int fd) : loop_(loop), fd_(fd), events_(0), lastEvents_(0) {}
+    Channel(EventLoop *loop) : loop_(loop), fd_(0), events_(0), revents_(0), lastEvents_(0), holder_(NULL) {}
+    Channel(EventLoop *loop, int fd) : loop_(loop), fd_(fd), events_(0), revents_(0), lastEvents_(0), holder_(NULL) {}
     ~Channel() {}
 
     int getfd() { return fd_; }
     void setfd(int fd) { fd_ = fd; }
-    void setHolder(std::shared_ptr<HttpData> holder) { holder_ = holder; }    
-    std::shared_ptr<HttpData> getHolder() {
-        std::shared_ptr<HttpData> ret(holder_.lock());
-        return ret;
+    // 持有者拥有这个Channel，Channel不会比它活得更久，所以只记裸指针
+    void setHolder(HttpData *holder) { holder_ = holder; }
+    HttpData *getHolder() { return holder_; }
+    // 连接对象复用时换上新的fd，回调保持不变
+    void reset(int fd) {
+        fd_ = fd;
+        events_ = revents_ = lastEvents_ = 0;
     }
      
     // 向Channel注册各类事件的处理函数
@@ -52,6 +55,9 @@ public:
     void handleEvents() {
         events_ = 0;
         if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN)) {
+            // 连接失败或者被对端重置，又没有可读的数据：连接靠超时清理；
+            // 等待这个fd的协程(只有它设置errorHandler_)要在这里恢复，否则会一直挂着
+            if (errorHandler_) errorHandler_();
             events_ = 0;
             return;
         }
@@ -72,6 +78,7 @@ public:
     // 设置及获取events、revents、lastEvents
     void setEvents(int ev) { events_ = ev; }
     void setRevents(int ev) { revents_ = ev; }
+    int getRevents() { return revents_; }
     int & getEvents() { return events_; }
 
     bool equalAndUpdateLastEvents() {
@@ -88,6 +95,6 @@ private:
     int events_; // 这个fd感兴趣的事件类型集合
     int revents_; // 事件监听器实际监听到的该fd发生的事件类型集合
     int lastEvents_; //??
-    std::weak_ptr<HttpData> holder_; // 方便找到上层持有该Channel的对象
+    HttpData *holder_; // 方便找到上层持有该Channel的对象
 };
 typedef std::shared_ptr<Channel> SPChannel;
\ No newline at end of file
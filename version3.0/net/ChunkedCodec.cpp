@@ -0,0 +1,146 @@
+#include "ChunkedCodec.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "HttpScanner.h"
+
+const size_t ChunkedDecoder::kMaxSizeLine;
+const size_t ChunkedDecoder::kMaxTrailerBytes;
+const size_t ChunkedDecoder::kMaxTrailers;
+
+namespace {
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+ChunkedDecoder::ChunkedDecoder(size_t maxBodySize)
+    : state_(kSize), remaining_(0), bodySize_(0), trailerBytes_(0), maxBodySize_(maxBodySize) {}
+
+void ChunkedDecoder::reset() {
+    state_ = kSize;
+    remaining_ = 0;
+    bodySize_ = 0;
+    trailerBytes_ = 0;
+}
+
+ChunkedDecoder::Result ChunkedDecoder::decode(const Buffer &buf, size_t &pos, Slices &body,
+                                              HttpHeaders &trailers) {
+    const char *begin = buf.peek();
+    const char *end = begin + buf.readableBytes();
+    while (state_ != kFinished) {
+        const char *p = begin + pos;
+        if (state_ == kSize) {
+            Result r = decodeSizeLine(begin, end, pos);
+            if (r != kDone) return r;
+        } else if (state_ == kData) {
+            // 收到多少记多少，同一块分几次收到时位置是连续的，合并成一段
+            size_t n = std::min(remaining_, static_cast<size_t>(end - p));
+            if (n == 0) return kNeedMore;
+            if (!body.empty() && body.back().first + body.back().second == pos)
+                body.back().second += n;
+            else
+                body.push_back(std::make_pair(pos, n));
+            pos += n;
+            remaining_ -= n;
+            bodySize_ += n;
+            if (remaining_ == 0) state_ = kDataCRLF;
+        } else if (state_ == kDataCRLF) {
+            if (end - p < 2) return kNeedMore;
+            if (p[0] != '\r' || p[1] != '\n') return kError;
+            pos += 2;
+            state_ = kSize;
+        } else {
+            Result r = decodeTrailer(begin, end, pos, trailers);
+            if (r != kDone) return r;
+        }
+    }
+    return kDone;
+}
+
+// "1a3f;name=value\r\n"：十六进制的块大小，后面可以跟块扩展，扩展的内容不关心
+// 整行收到后返回kDone并切换状态
+ChunkedDecoder::Result ChunkedDecoder::decodeSizeLine(const char *begin, const char *end, size_t &pos) {
+    const char *line = begin + pos;
+    const char *lf = static_cast<const char *>(memchr(line, '\n', end - line));
+    if (lf == NULL) return static_cast<size_t>(end - line) > kMaxSizeLine ? kError : kNeedMore;
+    if (static_cast<size_t>(lf - line) > kMaxSizeLine || lf == line || lf[-1] != '\r') return kError;
+    const char *cr = lf - 1;
+
+    size_t size = 0;
+    const char *p = line;
+    for (; p < cr && hexValue(*p) >= 0; ++p) {
+        // 超过15位十六进制数会溢出，这么大的块也不可能接受
+        if (p - line >= 15) return kError;
+        size = size * 16 + hexValue(*p);
+    }
+    if (p == line) return kError;
+    while (p < cr && (*p == ' ' || *p == '\t')) ++p;
+    if (p < cr && *p != ';') return kError;
+    if (findControlChar(p, cr) != cr) return kError;
+    pos = lf + 1 - begin;
+
+    if (size == 0) {
+        state_ = kTrailer;
+    } else {
+        if (size > maxBodySize_ - bodySize_) return kTooLarge;
+        remaining_ = size;
+        state_ = kData;
+    }
+    return kDone;
+}
+
+// 最后一块之后的trailer字段，格式同头部，以空行结束；整行收到后返回kDone
+ChunkedDecoder::Result ChunkedDecoder::decodeTrailer(const char *begin, const char *end, size_t &pos,
+                                                     HttpHeaders &trailers) {
+    const char *line = begin + pos;
+    const char *lf = static_cast<const char *>(memchr(line, '\n', end - line));
+    if (lf == NULL)
+        return trailerBytes_ + (end - line) > kMaxTrailerBytes ? kError : kNeedMore;
+    if (lf == line || lf[-1] != '\r') return kError;
+    const char *cr = lf - 1;
+    pos = lf + 1 - begin;
+    if (cr == line) {
+        state_ = kFinished;
+        return kDone;
+    }
+
+    trailerBytes_ += lf + 1 - line;
+    if (trailerBytes_ > kMaxTrailerBytes || trailers.size() >= kMaxTrailers) return kError;
+    const char *colon = findHeaderNameEnd(line, cr);
+    if (colon == line || colon == cr || *colon != ':') return kError;
+    if (findControlChar(colon + 1, cr) != cr) return kError;
+    const char *value = colon + 1, *valueEnd = cr;
+    while (value < valueEnd && (*value == ' ' || *value == '\t')) ++value;
+    while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) --valueEnd;
+    trailers.add(line - begin, colon - line, value - begin, valueEnd - value);
+    return kDone;
+}
+
+ssize_t ChunkedBodySource::read(Buffer &buf, size_t maxBytes) {
+    // 定长8位十六进制的块大小(允许前导0)加CRLF，数据后面还有一个CRLF
+    static const size_t kSizeLine = 10;
+    if (finished_) return 0;
+    assert(maxBytes > kSizeLine + 2);
+    buf.append("00000000\r\n", kSizeLine);
+    ssize_t n = source_->read(buf, maxBytes - kSizeLine - 2);
+    if (n < 0) return -1;
+    if (n == 0) {
+        // 占位的长度行正好就是最后的"0"块，再跟一个空行表示没有trailer
+        finished_ = true;
+        buf.append("\r\n", 2);
+        return kSizeLine + 2;
+    }
+    // 一块最多是输出队列一次取的量(64KB)，8位十六进制足够
+    char size[9];
+    snprintf(size, sizeof size, "%08x", static_cast<unsigned>(n));
+    memcpy(buf.beginWrite() - n - kSizeLine, size, 8);
+    buf.append("\r\n", 2);
+    return kSizeLine + n + 2;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <stddef.h>
+#include <utility>
+#include <vector>
+#include "BodySource.h"
+#include "Buffer.h"
+#include "HttpHeaders.h"
+#include "../base/noncopyable.h"
+
+// chunked编码的请求体的增量解码器
+// 数据在输入缓冲区里原地解码：不拷贝、不拼接，只记录每一块数据相对于Buffer::peek()的位置
+// (和HttpHeaders一样，请求处理完之前不retrieve，位置一直有效)；数据没收完整时停在当前位置，
+// 读到更多数据后从这里继续。trailer字段加到调用者给的HttpHeaders里
+class ChunkedDecoder : noncopyable {
+public:
+    enum Result { kNeedMore = 1, kDone, kError, kTooLarge };
+    // (偏移, 长度)，相邻的块合并成一段
+    typedef std::vector<std::pair<size_t, size_t>> Slices;
+
+    explicit ChunkedDecoder(size_t maxBodySize);
+
+    // 从buf.peek() + pos处继续解码，pos前移到已经处理过的位置；
+    // 请求体超过maxBodySize时返回kTooLarge
+    Result decode(const Buffer &buf, size_t &pos, Slices &body, HttpHeaders &trailers);
+    size_t bodySize() const { return bodySize_; }
+    void reset();
+
+    // 块大小那一行(含扩展)和全部trailer的长度上限，以及trailer的个数上限
+    static const size_t kMaxSizeLine = 1024;
+    static const size_t kMaxTrailerBytes = 8 * 1024;
+    static const size_t kMaxTrailers = 32;
+
+private:
+    enum State { kSize, kData, kDataCRLF, kTrailer, kFinished };
+
+    Result decodeSizeLine(const char *begin, const char *end, size_t &pos);
+    Result decodeTrailer(const char *begin, const char *end, size_t &pos, HttpHeaders &trailers);
+
+    State state_;
+    size_t remaining_; // 当前块还没收到的字节数
+    size_t bodySize_;
+    size_t trailerBytes_;
+    size_t maxBodySize_;
+};
+
+// 把长度事先未知的数据源包装成chunked编码：每次从内层数据源要一块，直接读进输出块，
+// 块大小那一行先占位、读完再填，不另外拷贝；内层结束时补上最后的"0"块
+class ChunkedBodySource : public BodySource {
+public:
+    explicit ChunkedBodySource(const SPBodySource &source) : source_(source), finished_(false) {}
+    ssize_t read(Buffer &buf, size_t maxBytes);
+
+private:
+    SPBodySource source_;
+    bool finished_;
+};
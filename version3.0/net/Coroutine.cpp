@@ -0,0 +1,155 @@
+#include "Coroutine.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "EventLoop.h"
+#include "../base/Logging.h"
+
+__thread FramePool *FramePool::t_current = NULL;
+
+FramePool::FramePool() {
+    memset(freeLists_, 0, sizeof freeLists_);
+    if (t_current == NULL) t_current = this;
+}
+
+FramePool::~FramePool() {
+    if (t_current == this) t_current = NULL;
+    for (int i = 0; i < kClasses; ++i) {
+        while (freeLists_[i]) {
+            FreeBlock *block = freeLists_[i];
+            freeLists_[i] = block->next;
+            free(block);
+        }
+    }
+}
+
+void *FramePool::allocate(size_t size) {
+    if (size > kMaxPooledSize) return malloc(size);
+    int index = static_cast<int>((size + kAlignment - 1) / kAlignment) - 1;
+    FreeBlock *block = freeLists_[index];
+    if (block == NULL) return malloc((index + 1) * kAlignment);
+    freeLists_[index] = block->next;
+    return block;
+}
+
+void FramePool::deallocate(void *p, size_t size) {
+    if (size > kMaxPooledSize) {
+        free(p);
+        return;
+    }
+    int index = static_cast<int>((size + kAlignment - 1) / kAlignment) - 1;
+    FreeBlock *block = static_cast<FreeBlock *>(p);
+    block->next = freeLists_[index];
+    freeLists_[index] = block;
+}
+
+namespace coro_detail {
+
+namespace {
+// 帧前面的头部，保持帧按max_align_t对齐
+const size_t kHeaderSize = 16;
+} // namespace
+
+void *allocateFrame(size_t size) {
+    FramePool *pool = FramePool::current();
+    size += kHeaderSize;
+    void *p = pool ? pool->allocate(size) : malloc(size);
+    if (p == NULL) throw std::bad_alloc();
+    *static_cast<FramePool **>(p) = pool;
+    return static_cast<char *>(p) + kHeaderSize;
+}
+
+void deallocateFrame(void *frame, size_t size) {
+    void *p = static_cast<char *>(frame) - kHeaderSize;
+    FramePool *pool = *static_cast<FramePool **>(p);
+    // 不是在分配它的线程里释放时，不能碰那个线程的空闲链表；池里的块也是malloc来的，直接free
+    if (pool && pool == FramePool::current())
+        pool->deallocate(p, size + kHeaderSize);
+    else
+        free(p);
+}
+
+void resumeInLoop(EventLoop *loop, std::coroutine_handle<> h) {
+    loop->queueInLoop([h]() { h.resume(); });
+}
+
+namespace {
+
+// spawn用的外壳：创建后立即运行，结束时自己销毁帧
+struct Detached {
+    struct promise_type : PooledPromise {
+        Detached get_return_object() { return Detached(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        // task的异常在runDetached里已经截住，到这里只能是onDone自己抛的
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+Detached runDetached(Task<void> task, std::function<void(bool)> onDone) {
+    bool ok = true;
+    try {
+        co_await task;
+    } catch (const std::exception &e) {
+        LOG << "coroutine exited with exception: " << e.what();
+        ok = false;
+    } catch (...) {
+        LOG << "coroutine exited with unknown exception";
+        ok = false;
+    }
+    if (onDone) onDone(ok);
+}
+
+} // namespace
+
+} // namespace coro_detail
+
+void spawn(Task<void> task, std::function<void(bool)> onDone) {
+    coro_detail::runDetached(std::move(task), std::move(onDone));
+}
+
+void FdAwaiter::await_suspend(std::coroutine_handle<> h) {
+    std::shared_ptr<Channel> channel(new Channel(loop_, fd_));
+    EventLoop *loop = loop_;
+    int *revents = &revents_;
+    // 只触发一次：读写事件可能同时到达，handleEvents里会先后调用两个回调
+    std::shared_ptr<bool> fired(new bool(false));
+    std::weak_ptr<Channel> weak(channel);
+    auto fire = [loop, weak, revents, fired, h]() {
+        if (*fired) return;
+        *fired = true;
+        std::shared_ptr<Channel> channel(weak.lock());
+        if (channel) {
+            *revents = channel->getRevents();
+            loop->removeFromPoller(channel);
+        }
+        // 在处理事件的过程中恢复协程，协程可能接着注册或者关闭同一个fd，放到这一轮事件处理完之后
+        coro_detail::resumeInLoop(loop, h);
+    };
+    channel->setReadHandler(fire);
+    channel->setWriteHandler(fire);
+    channel->setErrorHandler(fire);
+    channel->setEvents(events_ | EPOLLET);
+    loop_->addToPoller(channel);
+}
+
+SleepAwaiter::~SleepAwaiter() {
+    if (fd_ >= 0) close(fd_);
+}
+
+void SleepAwaiter::await_suspend(std::coroutine_handle<> h) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof spec);
+    spec.it_value.tv_sec = ms_ / 1000;
+    spec.it_value.tv_nsec = (ms_ % 1000) * 1000000L;
+    fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd_ < 0 || timerfd_settime(fd_, 0, &spec, NULL) < 0) {
+        // 建不了定时器时不睡，下一轮循环就继续
+        coro_detail::resumeInLoop(loop_, h);
+        return;
+    }
+    wait_ = FdAwaiter(loop_, fd_, EPOLLIN);
+    wait_.await_suspend(h);
+}
@@ -0,0 +1,206 @@
+#pragma once
+#include <assert.h>
+#include <stddef.h>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <utility>
+#include "../base/ThreadPool.h"
+#include "../base/noncopyable.h"
+
+class EventLoop;
+class Channel;
+
+// 协程帧的分配器，每个EventLoop一个：按64字节分档的空闲链表，释放的帧挂回链表给下一个协程用，
+// 稳定运行后创建协程不再调用malloc。只在所属loop的线程里使用，不加锁
+class FramePool : noncopyable {
+public:
+    FramePool();
+    ~FramePool();
+
+    void *allocate(size_t size);
+    void deallocate(void *p, size_t size);
+
+    // 当前线程的EventLoop的分配器，线程里没有EventLoop时为NULL
+    static FramePool *current() { return t_current; }
+
+private:
+    static const size_t kAlignment = 64;
+    static const size_t kMaxPooledSize = 4096; // 更大的帧直接用malloc
+    static const int kClasses = kMaxPooledSize / kAlignment;
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+    FreeBlock *freeLists_[kClasses];
+
+    static __thread FramePool *t_current;
+};
+
+namespace coro_detail {
+
+// 帧前面记下分配它的FramePool，协程在哪个线程结束都能还给原来的分配器
+void *allocateFrame(size_t size);
+void deallocateFrame(void *p, size_t size);
+// 在loop的线程里恢复h
+void resumeInLoop(EventLoop *loop, std::coroutine_handle<> h);
+
+struct PooledPromise {
+    static void *operator new(size_t size) { return allocateFrame(size); }
+    static void operator delete(void *p, size_t size) { deallocateFrame(p, size); }
+};
+
+} // namespace coro_detail
+
+template <typename T = void>
+class Task;
+
+namespace coro_detail {
+
+// 结束时转到等待它的协程(对称转移，不会越嵌越深)，没有就停在这里等Task析构
+struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+        std::coroutine_handle<> next = h.promise().continuation;
+        return next ? next : std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+};
+
+struct PromiseBase : PooledPromise {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+    T value;
+    Task<T> get_return_object();
+    template <typename U>
+    void return_value(U &&v) {
+        value = std::forward<U>(v);
+    }
+    T result() {
+        if (exception) std::rethrow_exception(exception);
+        return std::move(value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void result() {
+        if (exception) std::rethrow_exception(exception);
+    }
+};
+
+} // namespace coro_detail
+
+// 协程的返回类型：创建时不运行，被co_await或者交给spawn时才开始；
+// 在哪个loop的线程里开始，就一直在那个loop上运行(等待原语都在原loop上恢复)
+template <typename T>
+class Task : noncopyable {
+public:
+    typedef coro_detail::Promise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    explicit Task(Handle h) : handle_(h) {}
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, Handle())) {}
+    ~Task() {
+        if (handle_) handle_.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle_.promise().continuation = caller;
+        return handle_;
+    }
+    T await_resume() { return handle_.promise().result(); }
+
+private:
+    Handle handle_;
+};
+
+namespace coro_detail {
+
+template <typename T>
+Task<T> Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+} // namespace coro_detail
+
+// 在当前线程里开始运行task，不等待它结束；结束后调用onDone(ok)。
+// task抛出的异常在这里截住并写日志，ok为false，不会让整个进程退出
+void spawn(Task<void> task, std::function<void(bool)> onDone = std::function<void(bool)>());
+
+// 以下是EventLoop上的等待原语，返回值直接co_await
+
+// 等fd可读/可写，结果是实际发生的epoll事件(连接失败或者被重置时带EPOLLERR/EPOLLHUP)；
+// fd不能已经注册在这个loop上
+class FdAwaiter {
+public:
+    FdAwaiter(EventLoop *loop, int fd, int events) : loop_(loop), fd_(fd), events_(events), revents_(0) {}
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h);
+    int await_resume() const noexcept { return revents_; }
+
+private:
+    EventLoop *loop_;
+    int fd_;
+    int events_;
+    int revents_;
+};
+
+// 挂起ms毫秒，用一个一次性的timerfd实现
+class SleepAwaiter {
+public:
+    SleepAwaiter(EventLoop *loop, int ms) : loop_(loop), ms_(ms), fd_(-1), wait_(loop, -1, 0) {}
+    ~SleepAwaiter();
+    bool await_ready() const noexcept { return ms_ <= 0; }
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() const noexcept {}
+
+private:
+    EventLoop *loop_;
+    int ms_;
+    int fd_;
+    FdAwaiter wait_;
+};
+
+// fn在pool的线程里执行，执行完回到loop上继续；结果为false表示pool的队列已满，fn没有执行
+template <typename F>
+class ComputeAwaiter {
+public:
+    ComputeAwaiter(EventLoop *loop, ThreadPool &pool, F fn)
+        : loop_(loop), pool_(pool), fn_(std::move(fn)), submitted_(false) {}
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h) {
+        EventLoop *loop = loop_;
+        F *fn = &fn_;
+        submitted_ = pool_.trySubmit([loop, fn, h]() {
+            (*fn)();
+            coro_detail::resumeInLoop(loop, h);
+        });
+        // 没有提交成功就不挂起，直接继续
+        return submitted_;
+    }
+    bool await_resume() const noexcept { return submitted_; }
+
+private:
+    EventLoop *loop_;
+    ThreadPool &pool_;
+    F fn_;
+    bool submitted_;
+};
@@ -8,6 +8,8 @@
 #include <deque>
 #include <queue>
 #include <arpa/inet.h>
+#include "Util.h"
+#include "../base/CachedClock.h"
 #include "../base/Logging.h"
 
 #include <iostream>
@@ -15,11 +17,12 @@
 using namespace std;
 
 const int EVENTSNUM = 4096; // 可以监听的事件总数
-const int EPOLLWAIT_TIME = 10000; 
+const int EPOLLWAIT_TIME = 10000; // 没有定时器时最多等这么久
 
 typedef shared_ptr<Channel> SPChannel;
 
-EpollPoller::EpollPoller() : epollfd_(epoll_create1(EPOLL_CLOEXEC)), events_(EVENTSNUM) {
+EpollPoller::EpollPoller()
+    : epollfd_(epoll_create1(EPOLL_CLOEXEC)), events_(EVENTSNUM), fd2chan_(getOpenFileLimit()) {
   assert(epollfd_ > 0);
 }
 EpollPoller::~EpollPoller() {}
@@ -28,12 +31,9 @@ EpollPoller::~EpollPoller() {}
 void EpollPoller::addfd(SPChannel request, int timeout) {
     int fd = request->getfd(); // 获取Channel的文件描述符
     // 设置超时时间
-    if (timeout > 0) {
-        addTimer(request, timeout);
-    fd2http_[fd] = request->getHolder();
-    }
+    if (timeout > 0) addTimer(request, timeout);
     struct epoll_event event;
-    event.data.fd = fd;
+    event.data.ptr = request.get(); // 事件直接带回Channel，不用再按fd查表
     event.events = request->getEvents(); // 获取Channel注册的事件
     // Channel的注册发生在主线程上
 
@@ -51,11 +51,11 @@ void EpollPoller::modfd(SPChannel request, int timeout) {
     int fd = request->getfd();
     if (!request->equalAndUpdateLastEvents()) { // 新的events和旧的events不同
         struct epoll_event event;
-        event.data.fd = fd;
+        event.data.ptr = request.get();
         event.events = request->getEvents();
         if (epoll_ctl(epollfd_, EPOLL_CTL_MOD, fd, &event) < 0) {
             perror("epoll_mod error");
-            fd2chan_[fd].reset();
+            removedChannels_.push_back(std::move(fd2chan_[fd]));
         }
     }
 }
@@ -64,39 +64,45 @@ void EpollPoller::modfd(SPChannel request, int timeout) {
 void EpollPoller::delfd(SPChannel req) {
     int fd = req->getfd();
     struct epoll_event event;
-    event.data.fd = fd;
+    event.data.ptr = req.get();
     event.events = req->getLastEvents();
     if (epoll_ctl(epollfd_, EPOLL_CTL_DEL, fd, &event) < 0) {
         perror("epoll_del error");
     }
-    fd2chan_[fd].reset();
-    fd2http_[fd].reset();
+    // 调用者可能正在这个Channel的处理函数里，留到本轮结束再释放
+    SPChannel *registered = fd2chan_.find(fd);
+    if (registered && *registered) removedChannels_.push_back(std::move(*registered));
 }
 
+void EpollPoller::releaseRemoved() {
+    removedChannels_.clear();
+}
 
-// 返回活跃事件的channel智能指针列表
-std::vector<std::shared_ptr<Channel>> EpollPoller::poll() {
-    while (true) {
-        int event_count = epoll_wait(epollfd_, &*events_.begin(), events_.size(), EPOLLWAIT_TIME);
-        if (event_count < 0) perror("epoll wait error");
-        std::vector<SPChannel> req_data;
-        for (int i = 0; i < event_count; ++i) {
-            int fd = events_[i].data.fd; // 获取有事件产生的描述符
-            SPChannel cur_req = fd2chan_[fd]; // 获取该fd的保姆channel
-            if (cur_req) {
-                cur_req->setRevents(events_[i].events); // Revents就是实际发生的事件
-                cur_req->setEvents(0); // 这里把events置为零是为了重新设置监听事件
-                req_data.push_back(cur_req);
-            } else {
-                LOG << "SP cur_req is invalid";
-            }
-        }
-        if (req_data.size() > 0) return req_data; // 若活跃事件列表不为空则返回，否则继续循环等待
+
+// 把活跃事件的channel追加到activeChannels；最早的定时器到期时即使没有事件也返回
+void EpollPoller::poll(std::vector<Channel *> *activeChannels) {
+    int event_count = epoll_wait(epollfd_, &*events_.begin(), events_.size(), pollTimeout());
+    if (event_count < 0 && errno != EINTR) perror("epoll wait error");
+    for (int i = 0; i < event_count; ++i) {
+        // 注册时放进去的Channel，delfd之前一直由fd2chan_持有
+        Channel *cur_req = static_cast<Channel *>(events_[i].data.ptr);
+        cur_req->setRevents(events_[i].events); // Revents就是实际发生的事件
+        cur_req->setEvents(0); // 这里把events置为零是为了重新设置监听事件
+        activeChannels->push_back(cur_req);
     }
 }
 
+int EpollPoller::pollTimeout() {
+    int64_t next = timerManager_.nextExpiration();
+    if (next < 0) return EPOLLWAIT_TIME;
+    // 用本轮开始时缓存的时钟，本轮处理事件花的时间会让定时器晚这么一点触发
+    int64_t wait = next - CachedClock::nowMs();
+    if (wait <= 0) return 0;
+    return wait < EPOLLWAIT_TIME ? static_cast<int>(wait) : EPOLLWAIT_TIME;
+}
+
 void EpollPoller::addTimer(std::shared_ptr<Channel> req, int timeout) {
-    shared_ptr<HttpData> t = req->getHolder();
-    if (t) timerManager_.addTimer(t, timeout); // 每个Http连接都绑定一个Timer
+    HttpData *t = req->getHolder();
+    if (t) timerManager_.addTimer(t->getTimer(), timeout); // 每个Http连接都有一个嵌在里面的Timer
     else LOG << "timer add fail.";
 }
\ No newline at end of file
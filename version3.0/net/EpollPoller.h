@@ -11,6 +11,7 @@
 #include "Channel.h"
 #include "HttpData.h"
 #include "Timer.h"
+#include "../base/FdTable.h"
 
 // 实现一个事件监听器：
 // 功能：1. 负责监听文件描述符事件是否触发；2. 返回发生事件的文件描述符的具体事件
@@ -31,18 +32,25 @@ public:
 
     // ************* 重要 ***************
     // poll方法是Poller的核心方法，用于获取内核事件表中最新的事件
-    // 返回需要处理的活跃Channel列表（仍然通过智能指针安全返回）
-    std::vector<std::shared_ptr<Channel>> poll(); // 开启IO复用
+    // 活跃的Channel以裸指针追加到activeChannels里，由调用者复用这个数组；
+    // 注册着的Channel由fd2chan_持有，这一轮里被移除的Channel见releaseRemoved。
+    // 等待时间按最早的定时器算，到期时没有事件也返回(activeChannels为空)，好让handleExpired按时执行
+    void poll(std::vector<Channel *> *activeChannels); // 开启IO复用
+    // 一轮事件处理中被delfd移除的Channel先放在这里，整轮处理完再释放，
+    // 这样处理函数里关闭自己(或者同一批里的其它连接)时，Channel不会在用着的时候被析构
+    void releaseRemoved();
 
     // 定时器相关
     void addTimer(std::shared_ptr<Channel> req, int timeout);
-    void handleExpired() { timerManager_.handleExpiredEvent(); } 
+    void handleExpired() { timerManager_.handleExpiredEvent(); }
+    TimerManager &timerManager() { return timerManager_; }
 private:
-    static const int MAXFDS = 100000;
+    int pollTimeout(); // epoll_wait等多久：到最早的定时器到期为止
+
     int epollfd_; // 通过epoll_create方法返回的epoll句柄
     std::vector<epoll_event> events_; // 内核事件表
-    std::shared_ptr<Channel> fd2chan_[MAXFDS];
-    std::shared_ptr<HttpData> fd2http_[MAXFDS];
+    FdTable<SPChannel> fd2chan_; // 注册着的Channel，按RLIMIT_NOFILE预留，用到哪段才分配哪段
+    std::vector<SPChannel> removedChannels_;
 
     TimerManager timerManager_; //定时器
 };
\ No newline at end of file
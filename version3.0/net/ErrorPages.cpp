@@ -0,0 +1,57 @@
+#include "ErrorPages.h"
+
+std::vector<ErrorPage> ErrorPages::pages_;
+pthread_once_t ErrorPages::once_control_ = PTHREAD_ONCE_INIT;
+
+namespace {
+
+struct ErrorStatus {
+    int code;
+    const char *reason;
+    const char *extraFields; // 该状态码额外需要的头部字段
+};
+
+const ErrorStatus kErrorStatus[] = {
+    {500, "Internal Server Error", ""}, // 第一个是默认的
+    {400, "Bad Request", ""},
+    {403, "Forbidden", ""},
+    {404, "Not Found", ""},
+    {405, "Method Not Allowed", ""}, // Allow随配置变化，发送时再写
+    {413, "Payload Too Large", ""},
+    {414, "URI Too Long", ""},
+    {431, "Request Header Fields Too Large", ""},
+    {503, "Service Unavailable", "Retry-After: 1\r\n"},
+};
+
+} // namespace
+
+void ErrorPages::init() {
+    const size_t n = sizeof kErrorStatus / sizeof kErrorStatus[0];
+    pages_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        const ErrorStatus &s = kErrorStatus[i];
+        std::string status = std::to_string(s.code) + " " + s.reason;
+        std::string body;
+        body += "<html><title>哎~出错了</title>";
+        body += "<body bgcolor=\"ffffff\">";
+        body += status;
+        body += "<hr><em> LinYa's Web Server</em>\n</body></html>";
+
+        ErrorPage &page = pages_[i];
+        page.code = s.code;
+        page.statusLine = "HTTP/1.1 " + status + "\r\n";
+        page.tail += s.extraFields;
+        page.tail += "Content-Type: text/html\r\n";
+        page.tail += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        page.tail += "Server: LinYa's Web Server\r\n\r\n";
+        page.headerLength = page.tail.size();
+        page.tail += body;
+    }
+}
+
+const ErrorPage &ErrorPages::get(int code) {
+    pthread_once(&once_control_, &ErrorPages::init);
+    for (size_t i = 1; i < pages_.size(); ++i)
+        if (pages_[i].code == code) return pages_[i];
+    return pages_[0];
+}
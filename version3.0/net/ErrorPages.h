@@ -0,0 +1,30 @@
+#pragma once
+#include <pthread.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "../base/noncopyable.h"
+
+// 预先生成好的错误响应，分两段保存：
+// - statusLine: "HTTP/1.1 404 Not Found\r\n"
+// - tail: 其余头部字段、结束头部的空行和HTML正文
+// Date和Connection头部随时间和连接变化，发送时写在两段之间；两段都作为只读切片借给输出队列，不拷贝
+struct ErrorPage {
+    int code;
+    std::string statusLine;
+    std::string tail;
+    size_t headerLength; // tail中头部(含空行)的长度，HEAD请求只发送这一部分
+};
+
+// 启动时生成一次，之后只读，各IO线程共享
+class ErrorPages : noncopyable {
+public:
+    // 表里没有的状态码按500处理
+    static const ErrorPage &get(int code);
+
+private:
+    static void init();
+
+    static std::vector<ErrorPage> pages_;
+    static pthread_once_t once_control_;
+};
@@ -23,7 +23,8 @@ EventLoop::EventLoop() :
     eventHandling_(false),
     callingPendingFunctors_(false),
     threadId_(CurrentThread::tid()),
-    pwakeupChannel_(new Channel(this, wakeupFd_)) {
+    pwakeupChannel_(new Channel(this, wakeupFd_)),
+    timerSequence_(0) {
     // 保证one loop per thread
     if (t_loopInThisThread) {
         // LOG << "Another EventLoop " << t_loopInThisThread 
@@ -83,15 +84,17 @@ void EventLoop::loop() {
     assert(isInLoopThread()); // 验证是否运行在正确的线程上
     looping_ = true;
     quit_ = false;
-    std::vector<SPChannel> ret;
+    CachedClock::update();
     while (!quit_) {
-        ret.clear();
-        ret = poller_->poll(); // 返回活跃用户列表
+        activeChannels_.clear();
+        poller_->poll(&activeChannels_); // 活跃用户列表
+        CachedClock::update(); // 本轮循环中用到的时间都取这一次的读数
         eventHandling_ = true;
-        for (auto& it : ret) it->handleEvents(); // 每个channel轮流执行任务
+        for (size_t i = 0; i < activeChannels_.size(); ++i) activeChannels_[i]->handleEvents(); // 每个channel轮流执行任务
         eventHandling_ = false;
-        doPendingFunctors();
-        poller_->handleExpired(); // 最后再处理超时时间
+        poller_->handleExpired(); // 再处理超时时间
+        doPendingFunctors(); // 超时关闭的连接排进来的释放也在这一轮做掉
+        poller_->releaseRemoved(); // 本轮移除的Channel到这里才释放
     }
     looping_ = false;
 }
@@ -109,6 +112,32 @@ void EventLoop::doPendingFunctors() {
     callingPendingFunctors_ = false;
 }
 
+TimerId EventLoop::runAt(int64_t when, TimerCallback cb) {
+    return addTimer(when, 0, std::move(cb));
+}
+
+TimerId EventLoop::runAfter(int delay, TimerCallback cb) {
+    return addTimer(CachedClock::nowMs() + delay, 0, std::move(cb));
+}
+
+TimerId EventLoop::runEvery(int interval, TimerCallback cb) {
+    assert(interval > 0);
+    return addTimer(CachedClock::nowMs() + interval, interval, std::move(cb));
+}
+
+TimerId EventLoop::addTimer(int64_t when, int interval, TimerCallback &&cb) {
+    int64_t sequence = ++timerSequence_;
+    runInLoop([this, when, interval, sequence, cb]() mutable {
+        poller_->timerManager().schedule(when, interval, sequence, std::move(cb));
+    });
+    return TimerId(sequence);
+}
+
+void EventLoop::cancel(TimerId timerId) {
+    int64_t sequence = timerId.sequence();
+    runInLoop([this, sequence]() { poller_->timerManager().cancel(sequence); });
+}
+
 void EventLoop::quit() {
     quit_ = true;
     if (!isInLoopThread()) {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <sys/epoll.h>
@@ -9,7 +10,9 @@
 
 #include "EpollPoller.h"
 #include "Channel.h"
+#include "Coroutine.h"
 #include "Util.h"
+#include "../base/CachedClock.h"
 #include "../base/CurrentThread.h"
 #include "../base/Logging.h"
 #include "../base/Thread.h"
@@ -25,6 +28,7 @@ using namespace std;
 class EventLoop {
 public:
     typedef function<void()> Functor;
+    typedef function<void()> TimerCallback;
     typedef shared_ptr<Channel> SPChannel;
     EventLoop();
     ~EventLoop();
@@ -40,7 +44,25 @@ public:
     void addToPoller(shared_ptr<Channel> channel, int timeout = 0) { poller_->addfd(channel, timeout); }
     void updatePoller(SPChannel channel, int timeout = 0) { poller_->modfd(channel, timeout); }
     void removeFromPoller(SPChannel channel) { poller_->delfd(channel); }
+
+    // 定时器：时间是CachedClock::nowMs()的单调时钟，毫秒；可以在任意线程里调用，回调总在本loop的线程里执行。
+    // 其它线程里调用时经queueInLoop转到本loop，和同一线程之后的cancel保持先后顺序
+    TimerId runAt(int64_t when, TimerCallback cb);
+    TimerId runAfter(int delay, TimerCallback cb);
+    TimerId runEvery(int interval, TimerCallback cb);
+    void cancel(TimerId timerId);
+
+    // 协程里co_await的等待原语，只能在本loop的线程里使用，恢复后仍在本loop上运行
+    FdAwaiter readable(int fd) { return FdAwaiter(this, fd, EPOLLIN | EPOLLRDHUP); }
+    FdAwaiter writable(int fd) { return FdAwaiter(this, fd, EPOLLOUT); }
+    SleepAwaiter sleep(int ms) { return SleepAwaiter(this, ms); }
+    // fn交给pool执行，完成后回到本loop；结果为false表示队列已满、fn没有执行
+    template <typename F>
+    ComputeAwaiter<F> compute(ThreadPool &pool, F fn) {
+        return ComputeAwaiter<F>(this, pool, std::move(fn));
+    }
 private:
+    TimerId addTimer(int64_t when, int interval, TimerCallback &&cb);
     void wakeup();
     void handleRead();
     void doPendingFunctors();
@@ -56,4 +78,7 @@ private:
     bool callingPendingFunctors_; // 是否唤醒等待函数？用于帮助完成除了IO任务外的计算任务
     const pid_t threadId_; // 运行该loop的thread的id
     std::shared_ptr<Channel> pwakeupChannel_; // 当前被唤醒的channel
+    std::vector<Channel *> activeChannels_; // poll返回的活跃Channel，每轮复用
+    FramePool framePool_; // 本线程里创建的协程帧从这里分配
+    std::atomic<int64_t> timerSequence_; // TimerId的序号，各线程都可能分配
 };
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include "FileCache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "Channel.h"
+#include "EventLoop.h"
+#include "HttpData.h"
+#include "Util.h"
+#include "../base/Logging.h"
+
+pthread_once_t FileCache::once_control_ = PTHREAD_ONCE_INIT;
+FileCache *FileCache::instance_ = NULL;
+
+const size_t FileCache::kDefaultMaxOpenFiles;
+const size_t FileCache::kMaxTrackedChanges;
+
+namespace {
+// 目录里的文件被改写、删除、改名替换，或者目录本身被删除/移走，都要让缓存失效
+const uint32_t kWatchMask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE |
+                            IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                            IN_DELETE_SELF | IN_MOVE_SELF;
+
+// "dir/name" -> "dir"，没有'/'时为空串(当前目录)
+std::string dirOf(const std::string &path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? std::string() : path.substr(0, slash);
+}
+
+std::string joinPath(const std::string &dir, const char *name) {
+    return dir.empty() ? std::string(name) : dir + "/" + name;
+}
+
+// 按最后一个'/'之后的最后一个'.'取扩展名："app.min.js"是.js，"v1.2/x"没有扩展名
+std::string mimeOf(const std::string &path) {
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return MimeType::getMime("default");
+    return MimeType::getMime(path.substr(dot));
+}
+
+bool isCompressible(const std::string &mime) {
+    return mime.compare(0, 5, "text/") == 0 || mime == "application/javascript" ||
+           mime == "application/json" || mime == "application/xml" ||
+           mime == "image/svg+xml";
+}
+}
+
+CachedFile::~CachedFile() {
+    if (fd >= 0) close(fd);
+}
+
+FileCache &FileCache::instance() {
+    pthread_once(&once_control_, &FileCache::init);
+    return *instance_;
+}
+
+void FileCache::init() { instance_ = new FileCache(); }
+
+FileCache::FileCache()
+    : maxOpenFiles_(kDefaultMaxOpenFiles),
+      inotifyFd_(-1),
+      watching_(false),
+      loop_(NULL),
+      invalidations_(0),
+      clearedAt_(0) {}
+
+FileCache::~FileCache() {
+    if (inotifyFd_ >= 0) close(inotifyFd_);
+}
+
+void FileCache::watchInLoop(EventLoop *loop) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        LOG << "inotify_init1 failed, static file cache disabled";
+        return;
+    }
+    inotifyFd_ = fd;
+    loop_ = loop;
+    inotifyChannel_.reset(new Channel(loop, fd));
+    inotifyChannel_->setEvents(EPOLLIN | EPOLLET);
+    inotifyChannel_->setReadHandler(bind(&FileCache::handleRead, this));
+    inotifyChannel_->setConnHandler(bind(&FileCache::handleConn, this));
+    loop->addToPoller(inotifyChannel_, 0);
+    MutexLockGuard lock(mutex_);
+    watching_ = true;
+}
+
+bool FileCache::watching() const {
+    MutexLockGuard lock(mutex_);
+    return watching_;
+}
+
+void FileCache::setMaxOpenFiles(size_t n) {
+    MutexLockGuard lock(mutex_);
+    maxOpenFiles_ = n;
+    evictLocked();
+}
+
+SPCachedFile FileCache::get(const std::string &path) {
+    uint64_t generation;
+    bool watching;
+    {
+        MutexLockGuard lock(mutex_);
+        std::unordered_map<std::string, Entry>::iterator it = entries_.find(path);
+        if (it != entries_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second.pos);
+            return it->second.file;
+        }
+        watching = watching_;
+        generation = invalidations_;
+    }
+
+    // 先加watch再打开文件，保证打开之后发生的修改一定能收到通知
+    // 没有inotify时无法得知文件变化，只能每次重新打开
+    if (!watching || !addWatch(path)) return load(path);
+    SPCachedFile file = load(path);
+    if (!file) return file;
+
+    MutexLockGuard lock(mutex_);
+    // 加载期间发生过失效事件的话，刚读到的内容可能已经过时，这次不放进缓存
+    if (changedSinceLocked(path, generation)) return file;
+    std::unordered_map<std::string, Entry>::iterator it = entries_.find(path);
+    if (it != entries_.end()) return it->second.file;
+    lru_.push_front(file);
+    Entry entry;
+    entry.file = file;
+    entry.pos = lru_.begin();
+    entries_[path] = entry;
+    evictLocked();
+    return file;
+}
+
+SPCachedFile FileCache::find(const std::string &path) {
+    MutexLockGuard lock(mutex_);
+    std::unordered_map<std::string, Entry>::iterator it = entries_.find(path);
+    if (it == entries_.end()) return SPCachedFile();
+    lru_.splice(lru_.begin(), lru_, it->second.pos);
+    return it->second.file;
+}
+
+bool FileCache::validators(const std::string &path, FileValidators &v) {
+    SPCachedFile file = find(path);
+    if (file) {
+        v.etag = file->etag;
+        v.lastModified = file->lastModified;
+        v.mtime = file->st.st_mtime;
+        v.compressible = file->compressible;
+        return true;
+    }
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) return false;
+    v.etag = makeETag(st);
+    v.lastModified = httpDate(st.st_mtime);
+    v.mtime = st.st_mtime;
+    v.compressible = isCompressible(mimeOf(path));
+    return true;
+}
+
+// inode、大小和纳秒级的修改时间，文件被改写或替换后一定不同
+std::string FileCache::makeETag(const struct stat &st) {
+    char buf[64];
+    snprintf(buf, sizeof buf, "\"%lx-%lx-%lx\"", static_cast<unsigned long>(st.st_ino),
+             static_cast<unsigned long>(st.st_size),
+             static_cast<unsigned long>(st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec));
+    return buf;
+}
+
+void FileCache::invalidate(const std::string &path) {
+    std::vector<InvalidateCallback> callbacks;
+    {
+        MutexLockGuard lock(mutex_);
+        ++invalidations_;
+        markChangedLocked(path);
+        std::unordered_map<std::string, Entry>::iterator it = entries_.find(path);
+        if (it != entries_.end()) {
+            lru_.erase(it->second.pos);
+            entries_.erase(it);
+        }
+        callbacks = callbacks_;
+    }
+    for (size_t i = 0; i < callbacks.size(); ++i) callbacks[i](path);
+}
+
+void FileCache::addInvalidateCallback(const InvalidateCallback &cb) {
+    MutexLockGuard lock(mutex_);
+    callbacks_.push_back(cb);
+}
+
+SPCachedFile FileCache::load(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) return SPCachedFile();
+    std::shared_ptr<CachedFile> file(new CachedFile);
+    file->fd = fd;
+    if (fstat(fd, &file->st) < 0 || !S_ISREG(file->st.st_mode)) return SPCachedFile();
+    file->path = path;
+    file->mime = mimeOf(path);
+    file->lastModified = httpDate(file->st.st_mtime);
+    file->etag = makeETag(file->st);
+    file->compressible = isCompressible(file->mime);
+    file->header = "Content-Type: " + file->mime + "\r\n";
+    file->header += "Content-Length: " + std::to_string(file->st.st_size) + "\r\n";
+    file->header += "Last-Modified: " + file->lastModified + "\r\n";
+    file->header += "Accept-Ranges: bytes\r\n";
+    file->header += "ETag: " + file->etag + "\r\n";
+    // 同一URL可能返回压缩或未压缩的内容，告诉中间缓存要按Accept-Encoding区分
+    if (file->compressible) file->header += "Vary: Accept-Encoding\r\n";
+    return file;
+}
+
+bool FileCache::addWatch(const std::string &path) {
+    std::string dir = dirOf(path);
+    MutexLockGuard lock(mutex_);
+    if (dirWatches_.count(dir)) return true;
+    int wd = inotify_add_watch(inotifyFd_, dir.empty() ? "." : dir.c_str(), kWatchMask);
+    if (wd < 0) return false;
+    dirWatches_[dir] = wd;
+    watchDirs_[wd].push_back(dir);
+    return true;
+}
+
+void FileCache::evictLocked() {
+    while (lru_.size() > maxOpenFiles_) {
+        entries_.erase(lru_.back()->path);
+        lru_.pop_back();
+    }
+}
+
+void FileCache::markChangedLocked(const std::string &path) {
+    // 只是为了判断并发的加载是否过时，记录太多时整体清空，代价是这期间的加载都不进缓存
+    if (changedAt_.size() >= kMaxTrackedChanges) {
+        changedAt_.clear();
+        clearedAt_ = invalidations_;
+    }
+    changedAt_[path] = invalidations_;
+}
+
+bool FileCache::changedSinceLocked(const std::string &path, uint64_t generation) const {
+    if (clearedAt_ > generation) return true;
+    std::unordered_map<std::string, uint64_t>::const_iterator it = changedAt_.find(path);
+    return it != changedAt_.end() && it->second > generation;
+}
+
+void FileCache::handleRead() {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    std::vector<std::string> changed;
+    bool all = false;
+    std::vector<InvalidateCallback> callbacks;
+    while (true) {
+        ssize_t n = read(inotifyFd_, buf, sizeof buf);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (n == 0) break;
+        MutexLockGuard lock(mutex_);
+        ++invalidations_;
+        for (char *p = buf; p < buf + n;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                // 丢了事件或者目录本身没了，无法确定哪些文件受影响，全部清掉
+                entries_.clear();
+                lru_.clear();
+                clearedAt_ = invalidations_;
+                all = true;
+                if (event->mask & IN_IGNORED) {
+                    std::vector<std::string> &dirs = watchDirs_[event->wd];
+                    for (size_t i = 0; i < dirs.size(); ++i) dirWatches_.erase(dirs[i]);
+                    watchDirs_.erase(event->wd);
+                }
+                continue;
+            }
+            if (event->len == 0) continue;
+            std::unordered_map<int, std::vector<std::string>>::iterator w = watchDirs_.find(event->wd);
+            if (w == watchDirs_.end()) continue;
+            for (size_t i = 0; i < w->second.size(); ++i) {
+                std::string path = joinPath(w->second[i], event->name);
+                std::unordered_map<std::string, Entry>::iterator it = entries_.find(path);
+                if (it != entries_.end()) {
+                    lru_.erase(it->second.pos);
+                    entries_.erase(it);
+                }
+                markChangedLocked(path);
+                changed.push_back(path);
+            }
+        }
+        callbacks = callbacks_;
+    }
+    inotifyChannel_->setEvents(EPOLLIN | EPOLLET);
+
+    // 回调在锁外执行
+    if (all) {
+        changed.clear();
+        changed.push_back(std::string());
+    }
+    for (size_t i = 0; i < callbacks.size(); ++i)
+        for (size_t j = 0; j < changed.size(); ++j) callbacks[i](changed[j]);
+}
+
+void FileCache::handleConn() { loop_->updatePoller(inotifyChannel_); }
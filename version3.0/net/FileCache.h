@@ -0,0 +1,118 @@
+#pragma once
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../base/MutexLock.h"
+#include "../base/noncopyable.h"
+
+class EventLoop;
+class Channel;
+
+// 缓存的静态文件：stat结果、打开的fd、MIME类型以及预先生成好的响应头部字段
+// 创建后只读，多个连接可以同时用它的fd做sendfile（sendfile带offset参数，不改变文件偏移）
+// 被缓存淘汰或失效后，正在发送它的连接仍然通过shared_ptr持有它，最后一个持有者释放时才close
+struct CachedFile : noncopyable {
+    CachedFile() : fd(-1), compressible(false) {}
+    ~CachedFile();
+
+    std::string path;
+    struct stat st;
+    int fd;
+    std::string mime;
+    std::string lastModified; // HTTP-date格式的修改时间
+    std::string etag;         // 强校验的ETag，带引号
+    bool compressible;        // 文本类内容，值得做gzip压缩
+    // "Content-Type: ...\r\nContent-Length: ...\r\nLast-Modified: ...\r\nAccept-Ranges: bytes\r\nETag: ...\r\n"
+    // 可压缩的类型还带有"Vary: Accept-Encoding\r\n"
+    std::string header;
+};
+typedef std::shared_ptr<const CachedFile> SPCachedFile;
+
+// 条件请求用到的校验信息
+struct FileValidators {
+    std::string etag;
+    std::string lastModified;
+    time_t mtime;
+    bool compressible;
+};
+
+// 进程级的静态文件缓存，以请求的文件路径为key
+// 命中时不需要stat/open/close，也不需要再查MIME、拼头部
+// 文件变化通过inotify感知：对每个缓存过文件的目录加一个watch，inotify fd作为一个Channel挂在
+// 某个EventLoop上(Server中是主线程的loop)，目录中的文件被修改、删除、替换时把对应条目删掉
+// 打开的fd数量有上限，超过时按LRU淘汰
+class FileCache : noncopyable {
+public:
+    // 文件变化的通知，参数为失效的路径，空串表示全部失效；在watch所在的loop线程中调用
+    typedef std::function<void(const std::string &path)> InvalidateCallback;
+
+    static FileCache &instance();
+
+    // 查找文件，未命中时打开并加入缓存；文件不存在或不是普通文件时返回空
+    SPCachedFile get(const std::string &path);
+    // 只查找已经缓存的文件，不打开文件；没有inotify时总是返回空
+    SPCachedFile find(const std::string &path);
+    // 取文件的校验信息，文件已缓存时直接用缓存的，否则只stat不打开；文件不存在时返回false
+    bool validators(const std::string &path, FileValidators &v);
+    // 把inotify fd注册到loop上，之后文件变化会使缓存失效；不调用则缓存不会启用
+    void watchInLoop(EventLoop *loop);
+    // 是否能感知文件变化，不能的话依赖文件内容的缓存都不应该启用
+    bool watching() const;
+    void setMaxOpenFiles(size_t n);
+    void invalidate(const std::string &path);
+    // 基于文件内容做缓存的模块(如ResponseCache)通过它得知文件变化，不管文件当前是否在本缓存中
+    void addInvalidateCallback(const InvalidateCallback &cb);
+
+    static std::string makeETag(const struct stat &st);
+
+    static const size_t kDefaultMaxOpenFiles = 1024;
+    static const size_t kMaxTrackedChanges = 4096;
+
+private:
+    FileCache();
+    ~FileCache();
+    static void init();
+
+    SPCachedFile load(const std::string &path);
+    bool addWatch(const std::string &path);
+    void handleRead();
+    void handleConn();
+    void evictLocked();
+    void markChangedLocked(const std::string &path);
+    bool changedSinceLocked(const std::string &path, uint64_t generation) const;
+
+    typedef std::list<SPCachedFile> LruList;
+    struct Entry {
+        SPCachedFile file;
+        LruList::iterator pos;
+    };
+
+    mutable MutexLock mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    LruList lru_; // 队首为最近使用
+    size_t maxOpenFiles_;
+
+    int inotifyFd_;
+    bool watching_;
+    std::shared_ptr<Channel> inotifyChannel_;
+    EventLoop *loop_;
+    // 目录 -> watch描述符，以及watch描述符 -> 目录(同一目录可能以不同的写法出现)
+    std::unordered_map<std::string, int> dirWatches_;
+    std::unordered_map<int, std::vector<std::string>> watchDirs_;
+    std::vector<InvalidateCallback> callbacks_;
+    // 失效计数，每收到一批失效事件加一；并记录每个路径最近一次失效时的计数，
+    // 用来发现加载某个文件期间它是否发生了变化
+    uint64_t invalidations_;
+    std::unordered_map<std::string, uint64_t> changedAt_;
+    uint64_t clearedAt_;
+
+    static pthread_once_t once_control_;
+    static FileCache *instance_;
+};
@@ -0,0 +1,137 @@
+#include "GzipCompressor.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "ResponseCache.h"
+#include "../base/Logging.h"
+
+pthread_once_t GzipCompressor::once_control_ = PTHREAD_ONCE_INIT;
+GzipCompressor *GzipCompressor::instance_ = NULL;
+
+const size_t GzipCompressor::kMaxSourceSize;
+
+GzipCompressor &GzipCompressor::instance() {
+    pthread_once(&once_control_, &GzipCompressor::init);
+    return *instance_;
+}
+
+void GzipCompressor::init() {
+    instance_ = new GzipCompressor();
+    FileCache::instance().addInvalidateCallback(
+        std::bind(&GzipCompressor::invalidate, instance_, std::placeholders::_1));
+    instance_->thread_.start();
+}
+
+GzipCompressor::GzipCompressor()
+    : mutex_(), cond_(mutex_), thread_(std::bind(&GzipCompressor::threadFunc, this), "GzipCompressor") {}
+
+std::string GzipCompressor::gzipHeader(const CachedFile &file, size_t length) {
+    std::string header = "Content-Type: " + file.mime + "\r\n";
+    header += "Content-Encoding: gzip\r\n";
+    header += "Content-Length: " + std::to_string(length) + "\r\n";
+    header += "Last-Modified: " + file.lastModified + "\r\n";
+    header += "ETag: " + gzipETag(file.etag) + "\r\n";
+    header += "Vary: Accept-Encoding\r\n";
+    return header;
+}
+
+// 压缩后的内容和原文件不同，ETag也要不同："abc" -> "abc-gz"
+std::string GzipCompressor::gzipETag(const std::string &etag) {
+    if (etag.size() < 2) return etag;
+    return etag.substr(0, etag.size() - 1) + "-gz\"";
+}
+
+void GzipCompressor::request(const std::string &path, const SPCachedFile &file, uint64_t generation) {
+    if (static_cast<size_t>(file->st.st_size) > kMaxSourceSize) return;
+    MutexLockGuard lock(mutex_);
+    if (pending_.count(path) || skipped_.count(path)) return;
+    pending_.insert(path);
+    Job job;
+    job.path = path;
+    job.file = file;
+    job.generation = generation;
+    jobs_.push_back(job);
+    cond_.signal();
+}
+
+void GzipCompressor::invalidate(const std::string &path) {
+    MutexLockGuard lock(mutex_);
+    if (path.empty())
+        skipped_.clear();
+    else
+        skipped_.erase(path);
+}
+
+void GzipCompressor::threadFunc() {
+    while (true) {
+        Job job;
+        {
+            MutexLockGuard lock(mutex_);
+            while (jobs_.empty()) cond_.wait();
+            job = jobs_.front();
+            jobs_.pop_front();
+        }
+        process(job);
+        MutexLockGuard lock(mutex_);
+        pending_.erase(job.path);
+    }
+}
+
+void GzipCompressor::process(const Job &job) {
+    std::string body;
+    if (!compress(job.file->fd, job.file->st.st_size, body)) {
+        LOG << "gzip " << job.path << " failed";
+        return;
+    }
+    ResponseCache &cache = ResponseCache::instance();
+    // 压缩没有收益，或者放不进缓存，以后不再尝试(文件变化后重新评估)
+    if (body.size() >= static_cast<size_t>(job.file->st.st_size) ||
+        body.size() > cache.capacity()) {
+        MutexLockGuard lock(mutex_);
+        skipped_.insert(job.path);
+        return;
+    }
+
+    std::shared_ptr<CachedResponse> response(new CachedResponse);
+    response->data = gzipHeader(*job.file, body.size());
+    response->data += "Server: LinYa's Web Server\r\n\r\n";
+    response->headerLength = response->data.size();
+    response->data += body;
+    cache.insert(ResponseCache::gzipKey(job.path), response, job.generation);
+}
+
+bool GzipCompressor::compress(int fd, size_t size, std::string &out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof zs);
+    // windowBits加16表示输出gzip格式而不是zlib格式
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    char in[65536];
+    char chunk[65536];
+    size_t offset = 0;
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END) {
+        int flush = Z_NO_FLUSH;
+        if (zs.avail_in == 0) {
+            ssize_t n = 0;
+            if (offset < size) {
+                n = pread(fd, in, std::min(sizeof in, size - offset), offset);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                offset += n;
+            }
+            zs.next_in = reinterpret_cast<Bytef *>(in);
+            zs.avail_in = n;
+        }
+        if (offset >= size) flush = Z_FINISH;
+        zs.next_out = reinterpret_cast<Bytef *>(chunk);
+        zs.avail_out = sizeof chunk;
+        ret = deflate(&zs, flush);
+        if (ret == Z_STREAM_ERROR) break;
+        out.append(chunk, sizeof chunk - zs.avail_out);
+    }
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
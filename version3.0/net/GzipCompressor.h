@@ -0,0 +1,54 @@
+#pragma once
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include "FileCache.h"
+#include "../base/Condition.h"
+#include "../base/MutexLock.h"
+#include "../base/Thread.h"
+#include "../base/noncopyable.h"
+
+// 后台gzip压缩：文本类静态文件第一次被支持gzip的客户端请求时，在后台线程里压缩一次，
+// 结果作为该文件的gzip变体放进ResponseCache，之后的请求直接命中；压缩完成之前先返回未压缩的内容。
+// 压缩放在单独的线程里做，不占用IO线程
+class GzipCompressor : noncopyable {
+public:
+    static GzipCompressor &instance();
+
+    // 请求压缩path，同一文件的重复请求会被合并；压缩后不比原文件小、或者太大的文件不再尝试
+    void request(const std::string &path, const SPCachedFile &file, uint64_t generation);
+
+    // gzip变体除状态行外的头部字段(不含Server和空行)
+    static std::string gzipHeader(const CachedFile &file, size_t length);
+    static std::string gzipETag(const std::string &etag);
+
+    // 把fd的[0, size)压缩成gzip格式，追加到out；也给其它需要gzip的地方用(如POST /gzip)
+    static bool compress(int fd, size_t size, std::string &out);
+
+    static const size_t kMaxSourceSize = 8 * 1024 * 1024;
+
+private:
+    GzipCompressor();
+    static void init();
+
+    struct Job {
+        std::string path;
+        SPCachedFile file;
+        uint64_t generation;
+    };
+    void threadFunc();
+    void process(const Job &job);
+    void invalidate(const std::string &path);
+
+    MutexLock mutex_;
+    Condition cond_;
+    std::deque<Job> jobs_;
+    std::unordered_set<std::string> pending_;
+    std::unordered_set<std::string> skipped_;
+    Thread thread_;
+
+    static pthread_once_t once_control_;
+    static GzipCompressor *instance_;
+};
@@ -1,12 +1,20 @@
 // @Author Lin Ya
 // @Email xxbbb@vip.qq.com
 #include "HttpData.h"
-#include <fcntl.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
 #include <iostream>
+#include <vector>
+#include "../base/CachedClock.h"
 #include "Channel.h"
+#include "ErrorPages.h"
 #include "EventLoop.h"
+#include "FileCache.h"
+#include "GzipCompressor.h"
+#include "HttpScanner.h"
+#include "ResponseCache.h"
 #include "Util.h"
 #include "time.h"
 
@@ -18,6 +26,92 @@ std::unordered_map<std::string, std::string> MimeType::mime;
 const __uint32_t DEFAULT_EVENT = EPOLLIN | EPOLLET | EPOLLONESHOT;
 const int DEFAULT_EXPIRED_TIME = 2000;              // ms
 const int DEFAULT_KEEP_ALIVE_TIME = 5 * 60 * 1000;  // ms
+// 待发送的数据超过这个值时暂停处理管线中的后续请求，等发出去一些再继续
+const size_t OUTPUT_HIGH_WATER_MARK = 64 * 1024;
+// 输出积压且已经缓存了这么多请求数据时，暂时不再从socket读
+const size_t INPUT_HIGH_WATER_MARK = 64 * 1024;
+// 每次最多读这么多就先处理，读满了再接着读
+const size_t INPUT_READ_LIMIT = 256 * 1024;
+// 请求行加头部的最大长度和头部的最大个数，超过了按错误请求处理
+const size_t MAX_REQUEST_HEAD_SIZE = 64 * 1024;
+const size_t MAX_HEADERS = 100;
+// 请求体的最大长度，超过了回复413；请求体不在内存里攒着，这个值只受磁盘空间限制
+const size_t MAX_REQUEST_BODY_SIZE = 1024 * 1024 * 1024;
+// 超过这个长度的请求体转存到临时文件
+const size_t BODY_SPOOL_THRESHOLD = 64 * 1024;
+
+int HttpData::maxPipelinedRequests_ = HttpData::kDefaultMaxPipelinedRequests;
+const int HttpData::kDefaultMaxPipelinedRequests;
+bool HttpData::uploadsEnabled_ = false;
+
+// keep-alive连接上的响应都带这两个字段
+static const string &keepAliveFields() {
+  static const string fields = "Connection: Keep-Alive\r\nKeep-Alive: timeout=" +
+                               to_string(DEFAULT_KEEP_ALIVE_TIME) + "\r\n";
+  return fields;
+}
+
+// 去掉两端的空格和制表符
+static StringPiece trim(const char *begin, const char *end) {
+  while (begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+  while (end > begin && (end[-1] == ' ' || end[-1] == '\t')) --end;
+  return StringPiece(begin, end - begin);
+}
+
+// Content-Length只能是十进制数字
+static bool parseContentLength(const StringPiece &value, size_t &length) {
+  if (value.empty() || value.size() > 18) return false;
+  length = 0;
+  for (size_t i = 0; i < value.size(); ++i) {
+    if (value[i] < '0' || value[i] > '9') return false;
+    length = length * 10 + (value[i] - '0');
+  }
+  return true;
+}
+
+// 把请求的路径规范成FileCache/ResponseCache的键：合并连续的'/'，去掉"."这一级，按字面消掉".."，
+// 这样"a//b"、"./a/b"、"x/../a/b"和"a/b"是同一个文件，共用同一个fd和同一份缓存的响应。
+// 不解析符号链接(那要每个请求都realpath)；".."越过根目录时保持原样，交给escapesRoot拒绝
+static void normalizePath(string &path) {
+  // 绝大多数路径本来就是规范的，先粗略检查一遍，不需要时不分配内存
+  if (path[0] != '/' && path.find("//") == string::npos &&
+      path.find("./") == string::npos && path[path.size() - 1] != '.')
+    return;
+  string out;
+  size_t begin = 0;
+  while (begin < path.size()) {
+    size_t end = path.find('/', begin);
+    if (end == string::npos) end = path.size();
+    size_t len = end - begin;
+    if (len == 2 && path[begin] == '.' && path[begin + 1] == '.') {
+      if (out.empty()) return;
+      size_t slash = out.rfind('/');
+      out.resize(slash == string::npos ? 0 : slash);
+    } else if (len > 0 && !(len == 1 && path[begin] == '.')) {
+      if (!out.empty()) out += '/';
+      out.append(path, begin, len);
+    }
+    begin = end + 1;
+  }
+  if (out.empty())
+    out = "index.html";
+  else if (path[path.size() - 1] == '/')
+    out += '/';
+  path.swap(out);
+}
+
+// 绝对路径或者含有".."这一级的路径会跑到网站根目录外面(规范化之后只剩越过根目录的那些)
+static bool escapesRoot(const string &path) {
+  if (!path.empty() && path[0] == '/') return true;
+  size_t pos = 0;
+  while ((pos = path.find("..", pos)) != string::npos) {
+    if ((pos == 0 || path[pos - 1] == '/') &&
+        (pos + 2 == path.size() || path[pos + 2] == '/'))
+      return true;
+    pos += 2;
+  }
+  return false;
+}
 
 char favicon[555] = {
     '\x89', 'P',    'N',    'G',    '\xD',  '\xA',  '\x1A', '\xA',  '\x0',
@@ -98,6 +192,11 @@ void MimeType::init() {
   mime[".png"] = "image/png";
   mime[".txt"] = "text/plain";
   mime[".mp3"] = "audio/mp3";
+  mime[".css"] = "text/css";
+  mime[".js"] = "application/javascript";
+  mime[".json"] = "application/json";
+  mime[".xml"] = "application/xml";
+  mime[".svg"] = "image/svg+xml";
   mime["default"] = "text/html";
 }
 
@@ -109,8 +208,12 @@ std::string MimeType::getMime(const std::string &suffix) {
     return mime[suffix];
 }
 
-HttpData::HttpData(EventLoop *loop, int connfd)
-    : loop_(loop),
+// 每个IO线程自己的空闲连接对象，只在本线程里存取，不用加锁
+static __thread std::vector<HttpData *> *t_freeConnections = NULL;
+
+HttpData::HttpData(EventLoop *loop, int connfd, const Router *router)
+    : refs_(0),
+      loop_(loop),
       channel_(new Channel(loop, connfd)),
       fd_(connfd),
       error_(false),
@@ -119,55 +222,129 @@ HttpData::HttpData(EventLoop *loop, int connfd)
       HTTPVersion_(HTTP_11),
       nowReadPos_(0),
       state_(STATE_PARSE_URI),
-      hState_(H_START),
-      keepAlive_(false) {
+      keepAlive_(false),
+      headers_(inBuffer_),
+      router_(router),
+      route_(NULL),
+      allowedMethods_(0),
+      chunkedBody_(false),
+      bodyRemaining_(0),
+      chunked_(MAX_REQUEST_BODY_SIZE),
+      trailers_(inBuffer_),
+      inFlight_(0),
+      parked_(false),
+      timer_(bind(&HttpData::handleClose, this)) {
   // loop_->queueInLoop(bind(&HttpData::setHandlers, this));
   channel_->setReadHandler(bind(&HttpData::handleRead, this));
   channel_->setWriteHandler(bind(&HttpData::handleWrite, this));
   channel_->setConnHandler(bind(&HttpData::handleConn, this));
+  channel_->setHolder(this);
+}
+
+SPHttpData HttpData::create(EventLoop *loop, int connfd, const Router *router) {
+  loop->assertInLoopThread();
+  if (t_freeConnections && !t_freeConnections->empty()) {
+    HttpData *conn = t_freeConnections->back();
+    t_freeConnections->pop_back();
+    assert(conn->loop_ == loop);
+    conn->open(connfd, router);
+    return SPHttpData(conn);
+  }
+  return SPHttpData(new HttpData(loop, connfd, router));
+}
+
+void HttpData::release() {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+  // 最后一个引用可能在计算线程里释放，空闲链表是loop线程的
+  if (loop_->isInLoopThread())
+    recycle();
+  else
+    loop_->queueInLoop(std::bind(&HttpData::recycle, this));
+}
+
+void HttpData::open(int connfd, const Router *router) {
+  fd_ = connfd;
+  router_ = router;
+  channel_->reset(connfd);
+  error_ = false;
+  connectionState_ = H_CONNECTED;
+  method_ = METHOD_GET;
+  HTTPVersion_ = HTTP_11;
+  keepAlive_ = false;
+  inFlight_ = 0;
+  parked_ = false;
+}
+
+void HttpData::recycle() {
+  assert(refs_ == 0);
+  if (t_freeConnections == NULL) t_freeConnections = new std::vector<HttpData *>;
+  if (t_freeConnections->size() >= kMaxFreeConnections) {
+    delete this;
+    return;
+  }
+  close(fd_);
+  fd_ = -1;
+  // 放回之前先释放持有的外部资源：缓存文件的引用、临时文件，以及被大请求撑大的缓冲区
+  this->reset();
+  output_.clear();
+  inBuffer_.retrieveAll();
+  if (inBuffer_.internalCapacity() > INPUT_HIGH_WATER_MARK) inBuffer_.shrink(0);
+  t_freeConnections->push_back(this);
 }
 
 void HttpData::reset() {
-  // inBuffer_.clear();
+  // 请求行、头部和请求体一直留到请求处理完，这时才从输入缓冲区中丢弃
+  inBuffer_.retrieve(nowReadPos_);
   fileName_.clear();
   path_.clear();
   nowReadPos_ = 0;
   state_ = STATE_PARSE_URI;
-  hState_ = H_START;
   headers_.clear();
+  route_ = NULL;
+  params_.clear();
+  allowedMethods_ = 0;
+  bodySink_.reset();
+  chunkedBody_ = false;
+  bodyRemaining_ = 0;
+  body_.clear();
+  chunked_.reset();
+  trailers_.clear();
   // keepAlive_ = false;
-  if (timer_.lock()) {
-    shared_ptr<TimerNode> my_timer(timer_.lock());
-    my_timer->clearReq();
-    timer_.reset();
-  }
+  seperateTimer();
 }
 
 void HttpData::seperateTimer() {
   // cout << "seperateTimer" << endl;
-  if (timer_.lock()) {
-    shared_ptr<TimerNode> my_timer(timer_.lock());
-    my_timer->clearReq();
-    timer_.reset();
-  }
+  timer_.unlink();
 }
 
 void HttpData::handleRead() {
   int &events_ = channel_->getEvents();
+  bool zero = false;
+  bool more = false;
   do {
-    bool zero = false;
-    int read_num = readn(fd_, inBuffer_, zero);
-    LOG << "Request: " << inBuffer_;
+    ssize_t read_num = 0;
+    // 输出积压时先把已经收到的请求处理完，剩下的留在内核里，由TCP流控让对端慢下来
+    // 请求在计算线程池里时也不读，数据留在内核里
+    if (!parked_ && !(hasPendingOutput() &&
+                      inBuffer_.readableBytes() >= INPUT_HIGH_WATER_MARK))
+      read_num = readn(fd_, inBuffer_, zero, INPUT_READ_LIMIT);
+    // 分批读、分批处理，请求体边读边交给bodySink_，对端发得再快inBuffer_也不会攒下整个请求体；
+    // 没读到EAGAIN时处理完这一批接着读，边沿触发的事件不会丢
+    more = read_num >= static_cast<ssize_t>(INPUT_READ_LIMIT);
+    // 请求体不记日志，上传的文件不会整个写进日志
+    if (state_ != STATE_RECV_BODY)
+      (LOG << "Request: ")
+          .append(inBuffer_.peek(), static_cast<int>(inBuffer_.readableBytes()));
     if (connectionState_ == H_DISCONNECTING) {
-      inBuffer_.clear();
-      break;
+      inBuffer_.retrieveAll();
+      return;
     }
     // cout << inBuffer_ << endl;
     if (read_num < 0) {
       perror("1");
-      error_ = true;
-      handleError(fd_, 400, "Bad Request");
-      break;
+      handleError(400);
+      return;
     }
     // else if (read_num == 0)
     // {
@@ -178,25 +355,43 @@ void HttpData::handleRead() {
       // 有请求出现但是读不到数据，可能是Request
       // Aborted，或者来自网络的数据没有达到等原因
       // 最可能是对端已经关闭了，统一按照对端已经关闭处理
+      // 已经完整收到的请求仍然处理完
       // error_ = true;
       connectionState_ = H_DISCONNECTING;
-      if (read_num == 0) {
-        // error_ = true;
-        break;
-      }
-      // cout << "readnum == 0" << endl;
     }
 
+    // 缓冲区里所有完整的请求逐个处理，响应按顺序排进输出队列，最后一次writev发出；
+    // 积压超过高水位或者在途的请求数达到上限时先发送，能发出去就接着处理，否则等EPOLLOUT
+    int finished = 0;
+    while (true) {
+      finished += processRequests();
+      if (!hasPendingOutput()) break;
+      bool blocked = pipelineBlocked();
+      flushOutput();
+      if (error_ || !blocked || pipelineBlocked()) break;
+    }
+    // 请求还没收完整，继续等数据
+    if (!error_ && !parked_ && connectionState_ != H_DISCONNECTED &&
+        (finished == 0 || state_ != STATE_PARSE_URI || !inBuffer_.empty()))
+      events_ |= EPOLLIN;
+  } while (more && !error_ && !parked_ && connectionState_ == H_CONNECTED &&
+           !pipelineBlocked());
+}
+
+// 处理缓冲区里完整的请求，直到请求不完整、出错或者需要先发送积压的响应，返回处理完的请求数
+int HttpData::processRequests() {
+  int finished = 0;
+  while (!error_ && !parked_ && !pipelineBlocked()) {
     if (state_ == STATE_PARSE_URI) {
       URIState flag = this->parseURI();
       if (flag == PARSE_URI_AGAIN)
         break;
-      else if (flag == PARSE_URI_ERROR) {
+      else if (flag != PARSE_URI_SUCCESS) {
         perror("2");
-        LOG << "FD = " << fd_ << "," << inBuffer_ << "******";
-        inBuffer_.clear();
-        error_ = true;
-        handleError(fd_, 400, "Bad Request");
+        LOG << "FD = " << fd_ << "," << inBuffer_.toString() << "******";
+        handleError(flag == PARSE_URI_TOO_LONG     ? 414
+                    : flag == PARSE_URI_BAD_METHOD ? 405
+                                                   : 400);
         break;
       } else
         state_ = STATE_PARSE_HEADERS;
@@ -205,84 +400,216 @@ void HttpData::handleRead() {
       HeaderState flag = this->parseHeaders();
       if (flag == PARSE_HEADER_AGAIN)
         break;
-      else if (flag == PARSE_HEADER_ERROR) {
+      else if (flag != PARSE_HEADER_SUCCESS) {
         perror("3");
-        error_ = true;
-        handleError(fd_, 400, "Bad Request");
+        handleError(flag == PARSE_HEADER_TOO_LARGE ? 431 : 400);
         break;
       }
-      if (method_ == METHOD_POST) {
-        // POST方法准备
+      // 按方法和路径找处理函数，查找不分配内存
+      route_ = router_->find(method_, path_, params_, allowedMethods_);
+      // 带请求体的请求都要把请求体收完(不需要的就丢掉)，否则连接上后面的请求无法分界
+      if (method_ == METHOD_POST || method_ == METHOD_PUT ||
+          headers_.has(HDR_CONTENT_LENGTH) || headers_.has(HDR_TRANSFER_ENCODING)) {
+        int status = this->beginBody();
+        if (status != 0) {
+          handleError(status);
+          break;
+        }
         state_ = STATE_RECV_BODY;
       } else {
         state_ = STATE_ANALYSIS;
       }
     }
     if (state_ == STATE_RECV_BODY) {
-      int content_length = -1;
-      if (headers_.find("Content-length") != headers_.end()) {
-        content_length = stoi(headers_["Content-length"]);
-      } else {
-        // cout << "(state_ == STATE_RECV_BODY)" << endl;
-        error_ = true;
-        handleError(fd_, 400, "Bad Request: Lack of argument (Content-length)");
+      BodyState flag = this->receiveBody();
+      if (flag == BODY_AGAIN)
+        break;
+      else if (flag != BODY_SUCCESS) {
+        handleError(flag == BODY_TOO_LARGE    ? 413
+                    : flag == BODY_SINK_ERROR ? 500
+                                              : 400);
         break;
       }
-      if (static_cast<int>(inBuffer_.size()) < content_length) break;
       state_ = STATE_ANALYSIS;
     }
     if (state_ == STATE_ANALYSIS) {
       AnalysisState flag = this->analysisRequest();
-      if (flag == ANALYSIS_SUCCESS) {
-        state_ = STATE_FINISH;
-        break;
-      } else {
+      if (flag != ANALYSIS_SUCCESS) {
         // cout << "state_ == STATE_ANALYSIS" << endl;
-        error_ = true;
+        handleError(500);
         break;
       }
+      state_ = STATE_FINISH;
+      // 处理函数把计算交给了线程池，结果回来之后由resume结束这个请求
+      if (parked_) break;
     }
-  } while (false);
-  // cout << "state_=" << state_ << endl;
-  if (!error_) {
-    if (outBuffer_.size() > 0) {
-      handleWrite();
-      // events_ |= EPOLLOUT;
-    }
-    // error_ may change
-    if (!error_ && state_ == STATE_FINISH) {
-      this->reset();
-      if (inBuffer_.size() > 0) {
-        if (connectionState_ != H_DISCONNECTING) handleRead();
-      }
+    // 一个请求处理完，响应已经排进输出队列，接着处理下一个
+    this->reset();
+    ++finished;
+    ++inFlight_;
+  }
+  return finished;
+}
 
-      // if ((keepAlive_ || inBuffer_.size() > 0) && connectionState_ ==
-      // H_CONNECTED)
-      // {
-      //     this->reset();
-      //     events_ |= EPOLLIN;
-      // }
-    } else if (!error_ && connectionState_ != H_DISCONNECTED)
-      events_ |= EPOLLIN;
+// 根据头部确定请求体的长度和去处，成功返回0，否则返回要回复的错误状态码
+int HttpData::beginBody() {
+  chunkedBody_ = headers_.has(HDR_TRANSFER_ENCODING);
+  if (chunkedBody_) {
+    // 只支持单独的chunked编码；和Content-Length同时出现时请求的边界有歧义，一律拒绝
+    if (!headers_.get(HDR_TRANSFER_ENCODING).equalsIgnoreCase("chunked") ||
+        headers_.has(HDR_CONTENT_LENGTH) || HTTPVersion_ == HTTP_10)
+      return 400;
+  } else {
+    if (!parseContentLength(headers_.get(HDR_CONTENT_LENGTH), bodyRemaining_))
+      return 400;
+    if (bodyRemaining_ > MAX_REQUEST_BODY_SIZE) return 413;
   }
+
+  // 没有处理函数的请求不读请求体
+  if (!route_) return allowedMethods_ ? 405 : 404;
+  if (route_->sink) {
+    bodySink_ = route_->sink(*this, params_);
+    if (!bodySink_) return 403;
+  } else if (method_ == METHOD_POST || method_ == METHOD_PUT) {
+    bodySink_.reset(new SpoolBodySink(BODY_SPOOL_THRESHOLD));
+  } else {
+    bodySink_.reset(new DiscardBodySink);
+  }
+
+  // 客户端在等我们确认才发送请求体；要拒绝的请求在上面已经直接回复了错误，
+  // 请求体已经开始到达时也不用再确认
+  if (HTTPVersion_ == HTTP_11 && inBuffer_.readableBytes() == nowReadPos_ &&
+      headers_.get(HDR_EXPECT).equalsIgnoreCase("100-continue")) {
+    static const char continueLine[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    output_.appendSlice(continueLine, sizeof continueLine - 1);
+  }
+  return 0;
+}
+
+// 把inBuffer_中已经收到的请求体交给bodySink_，交出去的数据从inBuffer_中删掉，
+// 所以上传多大的文件，inBuffer_也只有一次read的大小
+BodyState HttpData::receiveBody() {
+  if (chunkedBody_) {
+    size_t pos = nowReadPos_;
+    ChunkedDecoder::Result flag = chunked_.decode(inBuffer_, pos, body_, trailers_);
+    for (size_t i = 0; i < body_.size(); ++i)
+      if (!bodySink_->write(inBuffer_.peek() + body_[i].first, body_[i].second))
+        return BODY_SINK_ERROR;
+    body_.clear();
+    if (flag == ChunkedDecoder::kError) return BODY_ERROR;
+    if (flag == ChunkedDecoder::kTooLarge) return BODY_TOO_LARGE;
+    // 分块的格式和数据一起删掉；trailer记录的是位置，有了trailer之后就不能再挪动数据了，
+    // 好在trailer有长度上限，留到请求处理完再丢弃
+    if (trailers_.size() == 0)
+      inBuffer_.erase(nowReadPos_, pos - nowReadPos_);
+    else
+      nowReadPos_ = pos;
+    if (flag == ChunkedDecoder::kNeedMore) return BODY_AGAIN;
+  } else {
+    size_t n = min(bodyRemaining_, inBuffer_.readableBytes() - nowReadPos_);
+    if (n > 0 && !bodySink_->write(inBuffer_.peek() + nowReadPos_, n))
+      return BODY_SINK_ERROR;
+    inBuffer_.erase(nowReadPos_, n);
+    bodyRemaining_ -= n;
+    if (bodyRemaining_ > 0) return BODY_AGAIN;
+  }
+  return bodySink_->finish() ? BODY_SUCCESS : BODY_SINK_ERROR;
 }
 
 void HttpData::handleWrite() {
-  if (!error_ && connectionState_ != H_DISCONNECTED) {
+  bool blocked = pipelineBlocked();
+  flushOutput();
+  // 之前因为积压暂停了处理管线请求(可能也暂停了读socket)，现在可以继续了
+  if (!error_ && blocked && !pipelineBlocked() &&
+      connectionState_ == H_CONNECTED)
+    handleRead();
+}
+
+void HttpData::offload(ThreadPool &pool, const Work &work) {
+  SPHttpData self(this);
+  // 线程数为0时work在这里直接执行，parked_要先设好
+  parked_ = true;
+  bool submitted = pool.trySubmit([self, work]() {
+    Completion done = work();
+    self->loop_->queueInLoop(std::bind(&HttpData::resume, self, done));
+  });
+  if (!submitted) {
+    parked_ = false;
+    LOG << "compute pool " << pool.name() << " is full, shedding " << path_;
+    appendError(503, false);
+  }
+}
+
+void HttpData::resume(const Completion &done) {
+  if (connectionState_ != H_DISCONNECTED) {
+    if (done)
+      done(*this);
+    else
+      appendError(500, false);
+  }
+  finishParked();
+}
+
+void HttpData::runTask(Task<> task) {
+  parked_ = true;
+  SPHttpData self(this);
+  // 协程可能没有挂起就直接结束了，这时还在processRequests里，结束请求的工作放到loop的下一轮
+  spawn(std::move(task), [self](bool ok) {
+    self->loop_->queueInLoop([self, ok]() {
+      // 处理函数抛出了异常(spawn已经写了日志)，响应可能只生成了一半，回500后关闭连接
+      if (!ok && self->connectionState_ != H_DISCONNECTED) self->handleError(500);
+      self->finishParked();
+    });
+  });
+}
+
+void HttpData::finishParked() {
+  parked_ = false;
+  if (connectionState_ == H_DISCONNECTED) return;
+  // 结束暂停的请求，再接着处理暂停期间收到的数据，和Channel处理一次事件的流程一样
+  this->reset();
+  ++inFlight_;
+  channel_->getEvents() = 0;
+  handleRead();
+  handleConn();
+}
+
+void HttpData::flushOutput() {
+  // 出错后已经排队的响应(包括错误页)也要发完
+  if (connectionState_ != H_DISCONNECTED) {
     int &events_ = channel_->getEvents();
-    if (writen(fd_, outBuffer_) < 0) {
-      perror("writen");
+    // 头部、内存切片、文件段和数据源按顺序由输出队列发送，能发多少发多少
+    if (output_.flush(fd_) < 0) {
+      perror("writev/sendfile");
+      output_.clear();
       events_ = 0;
       error_ = true;
+      return;
     }
-    if (outBuffer_.size() > 0) events_ |= EPOLLOUT;
+    if (hasPendingOutput())
+      events_ |= EPOLLOUT;
+    else
+      inFlight_ = 0;
   }
 }
 
+// 待发送的数据超过高水位，或者响应还没发完的请求数达到上限
+bool HttpData::pipelineBlocked() const {
+  return inFlight_ >= maxPipelinedRequests_ || outputBackedUp();
+}
+
+bool HttpData::outputBackedUp() const {
+  return output_.pendingBytes() >= OUTPUT_HIGH_WATER_MARK;
+}
+
 void HttpData::handleConn() {
   seperateTimer();
   int &events_ = channel_->getEvents();
-  if (!error_ && connectionState_ == H_CONNECTED) {
+  if (!error_ && connectionState_ == H_CONNECTED && parked_) {
+    // 等计算结果期间不读也不计超时，只发送已经排队的响应
+    events_ |= EPOLLET;
+    loop_->updatePoller(channel_);
+  } else if (!error_ && connectionState_ == H_CONNECTED) {
     if (events_ != 0) {
       int timeout = DEFAULT_EXPIRED_TIME;
       if (keepAlive_) timeout = DEFAULT_KEEP_ALIVE_TIME;
@@ -302,316 +629,646 @@ void HttpData::handleConn() {
     } else {
       // cout << "close normally" << endl;
       // loop_->shutdown(channel_);
-      // loop_->runInLoop(bind(&HttpData::handleClose, shared_from_this()));
+      // loop_->runInLoop(bind(&HttpData::handleClose, SPHttpData(this)));
       events_ |= (EPOLLIN | EPOLLET);
       // events_ |= (EPOLLIN | EPOLLET | EPOLLONESHOT);
       int timeout = (DEFAULT_KEEP_ALIVE_TIME >> 1);
       loop_->updatePoller(channel_, timeout);
     }
-  } else if (!error_ && connectionState_ == H_DISCONNECTING &&
-             (events_ & EPOLLOUT)) {
+  } else if (connectionState_ == H_DISCONNECTING && (events_ & EPOLLOUT)) {
+    // 出错或者对端已经关闭，只等剩下的响应发完，发完后关闭
     events_ = (EPOLLOUT | EPOLLET);
+    loop_->updatePoller(channel_, DEFAULT_EXPIRED_TIME);
   } else {
     cout << "close with errors" << endl;
-    loop_->runInLoop(bind(&HttpData::handleClose, shared_from_this()));
+    loop_->runInLoop(bind(&HttpData::handleClose, SPHttpData(this)));
   }
 }
 
 URIState HttpData::parseURI() {
-  string &str = inBuffer_;
-  string cop = str;
-  // 读到完整的请求行再开始解析请求
-  size_t pos = str.find('\r', nowReadPos_);
-  if (pos < 0) {
+  // 读到完整的请求行再开始解析请求；请求行和头部在请求处理完之前一直留在inBuffer_里，
+  // headers_只记录其中的位置，nowReadPos_是已经解析到的位置(相对于peek()的偏移)
+  const char *begin = inBuffer_.peek();
+  const char *end = begin + inBuffer_.readableBytes();
+  // 请求行里不能有控制字符，扫描会停在行尾的CRLF上
+  const char *crlf = findControlChar(begin, end);
+  if (crlf == end || (*crlf == '\r' && crlf + 1 == end)) {
+    if (inBuffer_.readableBytes() > MAX_REQUEST_HEAD_SIZE) return PARSE_URI_TOO_LONG;
     return PARSE_URI_AGAIN;
   }
-  // 去掉请求行所占的空间，节省空间
-  string request_line = str.substr(0, pos);
-  if (str.size() > pos + 1)
-    str = str.substr(pos + 1);
-  else
-    str.clear();
-  // Method
-  int posGet = request_line.find("GET");
-  int posPost = request_line.find("POST");
-  int posHead = request_line.find("HEAD");
-
-  if (posGet >= 0) {
-    pos = posGet;
+  if (crlf[0] != '\r' || crlf[1] != '\n') return PARSE_URI_ERROR;
+  nowReadPos_ = crlf + 2 - begin;
+
+  // Method: 请求行的第一个词
+  const char *sp = static_cast<const char *>(memchr(begin, ' ', crlf - begin));
+  if (sp == NULL) return PARSE_URI_ERROR;
+  StringPiece method(begin, sp - begin);
+  if (method == "GET")
     method_ = METHOD_GET;
-  } else if (posPost >= 0) {
-    pos = posPost;
+  else if (method == "POST")
     method_ = METHOD_POST;
-  } else if (posHead >= 0) {
-    pos = posHead;
+  else if (method == "HEAD")
     method_ = METHOD_HEAD;
-  } else {
-    return PARSE_URI_ERROR;
-  }
+  else if (method == "PUT")
+    method_ = METHOD_PUT;
+  else if (method == "DELETE")
+    method_ = METHOD_DELETE;
+  else
+    return PARSE_URI_BAD_METHOD;
 
   // filename
-  pos = request_line.find("/", pos);
-  if (pos < 0) {
-    fileName_ = "index.html";
-    HTTPVersion_ = HTTP_11;
-    return PARSE_URI_SUCCESS;
-  } else {
-    size_t _pos = request_line.find(' ', pos);
-    if (_pos < 0)
+  const char *uri = sp + 1;
+  const char *uriEnd = static_cast<const char *>(memchr(uri, ' ', crlf - uri));
+  if (uriEnd == NULL || uriEnd == uri) return PARSE_URI_ERROR;
+  if (*uri != '/') {
+    // absolute-form，例如"GET http://host/index.html HTTP/1.1"，只取其中的路径
+    StringPiece target(uri, uriEnd - uri);
+    if (!target.starts_with("http://") && !target.starts_with("https://"))
       return PARSE_URI_ERROR;
-    else {
-      if (_pos - pos > 1) {
-        fileName_ = request_line.substr(pos + 1, _pos - pos - 1);
-        size_t __pos = fileName_.find('?');
-        if (__pos >= 0) {
-          fileName_ = fileName_.substr(0, __pos);
-        }
-      }
-
-      else
-        fileName_ = "index.html";
-    }
-    pos = _pos;
+    const char *authority = uri + (target.starts_with("http://") ? 7 : 8);
+    uri = std::find(authority, uriEnd, '/');
+  }
+  const char *pathEnd = std::find(uri, uriEnd, '?');
+  if (pathEnd > uri)
+    path_.assign(uri, pathEnd);
+  else
+    path_ = "/";
+  if (pathEnd - uri > 1) {
+    fileName_.assign(uri + 1, pathEnd);
+    normalizePath(fileName_);
+  } else {
+    fileName_ = "index.html";
   }
-  // cout << "fileName_: " << fileName_ << endl;
+
   // HTTP 版本号
-  pos = request_line.find("/", pos);
-  if (pos < 0)
+  StringPiece ver(uriEnd + 1, crlf - uriEnd - 1);
+  if (ver == "HTTP/1.0")
+    HTTPVersion_ = HTTP_10;
+  else if (ver == "HTTP/1.1")
+    HTTPVersion_ = HTTP_11;
+  else
     return PARSE_URI_ERROR;
-  else {
-    if (request_line.size() - pos <= 3)
-      return PARSE_URI_ERROR;
-    else {
-      string ver = request_line.substr(pos + 1, 3);
-      if (ver == "1.0")
-        HTTPVersion_ = HTTP_10;
-      else if (ver == "1.1")
-        HTTPVersion_ = HTTP_11;
-      else
-        return PARSE_URI_ERROR;
-    }
-  }
   return PARSE_URI_SUCCESS;
 }
 
 HeaderState HttpData::parseHeaders() {
-  string &str = inBuffer_;
-  int key_start = -1, key_end = -1, value_start = -1, value_end = -1;
-  int now_read_line_begin = 0;
-  bool notFinish = true;
-  size_t i = 0;
-  for (; i < str.size() && notFinish; ++i) {
-    switch (hState_) {
-      case H_START: {
-        if (str[i] == '\n' || str[i] == '\r') break;
-        hState_ = H_KEY;
-        key_start = i;
-        now_read_line_begin = i;
-        break;
-      }
-      case H_KEY: {
-        if (str[i] == ':') {
-          key_end = i;
-          if (key_end - key_start <= 0) return PARSE_HEADER_ERROR;
-          hState_ = H_COLON;
-        } else if (str[i] == '\n' || str[i] == '\r')
-          return PARSE_HEADER_ERROR;
-        break;
-      }
-      case H_COLON: {
-        if (str[i] == ' ') {
-          hState_ = H_SPACES_AFTER_COLON;
-        } else
-          return PARSE_HEADER_ERROR;
-        break;
-      }
-      case H_SPACES_AFTER_COLON: {
-        hState_ = H_VALUE;
-        value_start = i;
-        break;
-      }
-      case H_VALUE: {
-        if (str[i] == '\r') {
-          hState_ = H_CR;
-          value_end = i;
-          if (value_end - value_start <= 0) return PARSE_HEADER_ERROR;
-        } else if (i - value_start > 255)
-          return PARSE_HEADER_ERROR;
-        break;
-      }
-      case H_CR: {
-        if (str[i] == '\n') {
-          hState_ = H_LF;
-          string key(str.begin() + key_start, str.begin() + key_end);
-          string value(str.begin() + value_start, str.begin() + value_end);
-          headers_[key] = value;
-          now_read_line_begin = i;
-        } else
-          return PARSE_HEADER_ERROR;
-        break;
-      }
-      case H_LF: {
-        if (str[i] == '\r') {
-          hState_ = H_END_CR;
-        } else {
-          key_start = i;
-          hState_ = H_KEY;
-        }
-        break;
-      }
-      case H_END_CR: {
-        if (str[i] == '\n') {
-          hState_ = H_END_LF;
-        } else
-          return PARSE_HEADER_ERROR;
-        break;
-      }
-      case H_END_LF: {
-        notFinish = false;
-        key_start = i;
-        now_read_line_begin = i;
-        break;
-      }
+  // 从nowReadPos_处的行首开始逐行解析；遇到不完整的行就停在它的行首，读到更多数据后从这里继续
+  // 名字和值各扫描一遍，扫描同时检查非法字符，一次比较16/32个字节
+  const char *begin = inBuffer_.peek();
+  const char *end = begin + inBuffer_.readableBytes();
+  while (true) {
+    const char *line = begin + nowReadPos_;
+    // 名字停在':'上；停在行首的'\r'上是结束头部的空行；停在别处(空白、控制字符)都是非法的
+    const char *colon = findHeaderNameEnd(line, end);
+    if (colon == end) break;
+    if (*colon != ':') {
+      if (colon != line || *colon != '\r') return PARSE_HEADER_ERROR;
+      if (colon + 1 == end) break;
+      if (colon[1] != '\n') return PARSE_HEADER_ERROR;
+      // 头部结束，nowReadPos_停在请求体(或下一个请求)的开头
+      nowReadPos_ = colon + 2 - begin;
+      return PARSE_HEADER_SUCCESS;
     }
+    if (colon == line) return PARSE_HEADER_ERROR;
+
+    // 值里可以有制表符，不能有其它控制字符，扫描停在行尾的CRLF上
+    const char *cr = findControlChar(colon + 1, end);
+    if (cr == end || (*cr == '\r' && cr + 1 == end)) break;
+    if (cr[0] != '\r' || cr[1] != '\n') return PARSE_HEADER_ERROR;
+    nowReadPos_ = cr + 2 - begin;
+
+    StringPiece value = trim(colon + 1, cr);
+    if (headers_.size() >= MAX_HEADERS) return PARSE_HEADER_TOO_LARGE;
+    headers_.add(line - begin, colon - line, value.data() - begin, value.size());
   }
-  if (hState_ == H_END_LF) {
-    str = str.substr(i);
-    return PARSE_HEADER_SUCCESS;
-  }
-  str = str.substr(now_read_line_begin);
+  if (inBuffer_.readableBytes() > MAX_REQUEST_HEAD_SIZE) return PARSE_HEADER_TOO_LARGE;
   return PARSE_HEADER_AGAIN;
 }
 
 AnalysisState HttpData::analysisRequest() {
-  if (method_ == METHOD_POST) {
-    // ------------------------------------------------------
-    // My CV stitching handler which requires OpenCV library
-    // ------------------------------------------------------
-    // string header;
-    // header += string("HTTP/1.1 200 OK\r\n");
-    // if(headers_.find("Connection") != headers_.end() &&
-    // headers_["Connection"] == "Keep-Alive")
-    // {
-    //     keepAlive_ = true;
-    //     header += string("Connection: Keep-Alive\r\n") + "Keep-Alive:
-    //     timeout=" + to_string(DEFAULT_KEEP_ALIVE_TIME) + "\r\n";
-    // }
-    // int length = stoi(headers_["Content-length"]);
-    // vector<char> data(inBuffer_.begin(), inBuffer_.begin() + length);
-    // Mat src = imdecode(data, CV_LOAD_IMAGE_ANYDEPTH|CV_LOAD_IMAGE_ANYCOLOR);
-    // //imwrite("receive.bmp", src);
-    // Mat res = stitch(src);
-    // vector<uchar> data_encode;
-    // imencode(".png", res, data_encode);
-    // header += string("Content-length: ") + to_string(data_encode.size()) +
-    // "\r\n\r\n";
-    // outBuffer_ += header + string(data_encode.begin(), data_encode.end());
-    // inBuffer_ = inBuffer_.substr(length);
-    // return ANALYSIS_SUCCESS;
-  } else if (method_ == METHOD_GET || method_ == METHOD_HEAD) {
-    string header;
-    header += "HTTP/1.1 200 OK\r\n";
-    if (headers_.find("Connection") != headers_.end() &&
-        (headers_["Connection"] == "Keep-Alive" ||
-         headers_["Connection"] == "keep-alive")) {
-      keepAlive_ = true;
-      header += string("Connection: Keep-Alive\r\n") + "Keep-Alive: timeout=" +
-                to_string(DEFAULT_KEEP_ALIVE_TIME) + "\r\n";
-    }
-    int dot_pos = fileName_.find('.');
-    string filetype;
-    if (dot_pos < 0)
-      filetype = MimeType::getMime("default");
-    else
-      filetype = MimeType::getMime(fileName_.substr(dot_pos));
+  if (headers_.get(HDR_CONNECTION).equalsIgnoreCase("Keep-Alive")) {
+    keepAlive_ = true;
+  }
+  if (!route_) {
+    appendError(allowedMethods_ ? 405 : 404, false);
+    return ANALYSIS_SUCCESS;
+  }
+  route_->handler(*this, params_);
+  return ANALYSIS_SUCCESS;
+}
 
-    // echo test
-    if (fileName_ == "hello") {
-      outBuffer_ =
-          "HTTP/1.1 200 OK\r\nContent-type: text/plain\r\n\r\nHello World";
-      return ANALYSIS_SUCCESS;
-    }
-    if (fileName_ == "favicon.ico") {
-      header += "Content-Type: image/png\r\n";
-      header += "Content-Length: " + to_string(sizeof favicon) + "\r\n";
-      header += "Server: LinYa's Web Server\r\n";
-
-      header += "\r\n";
-      outBuffer_ += header;
-      outBuffer_ += string(favicon, favicon + sizeof favicon);
-      ;
-      return ANALYSIS_SUCCESS;
-    }
+void HttpData::registerRoutes(Router &router, ThreadPool &computePool) {
+  const int get = Router::method(METHOD_GET) | Router::method(METHOD_HEAD);
+  // echo test
+  router.add(get, "/hello", [](HttpData &conn, const RouteParams &) {
+    static const char hello[] = "Hello World";
+    Buffer &header = conn.appendStatusLine();
+    header.append("Content-Type: text/plain\r\n");
+    header.append("Content-Length: " + to_string(sizeof hello - 1) + "\r\n");
+    header.append("Server: LinYa's Web Server\r\n");
+    header.append("\r\n");
+    if (conn.method_ != METHOD_HEAD) conn.output_.appendSlice(hello, sizeof hello - 1);
+  });
+  router.add(get, "/favicon.ico", [](HttpData &conn, const RouteParams &) {
+    Buffer &header = conn.appendStatusLine();
+    header.append("Content-Type: image/png\r\n");
+    header.append("Content-Length: " + to_string(sizeof favicon) + "\r\n");
+    header.append("Server: LinYa's Web Server\r\n");
+    header.append("\r\n");
+    // 响应体是静态数组，直接借用，不拷贝
+    if (conn.method_ != METHOD_HEAD) conn.output_.appendSlice(favicon, sizeof favicon);
+  });
+  router.add(Router::method(METHOD_POST), "/echo",
+             [](HttpData &conn, const RouteParams &) { conn.echoBody(); });
+  // 原来的OpenCV拼接这类耗CPU的处理都按这种方式交给计算线程池，不阻塞IO线程；
+  // 请求体总是放进临时文件，计算线程直接读fd
+  ThreadPool *pool = &computePool;
+  router.add(
+      Router::method(METHOD_POST), "/gzip",
+      [pool](HttpData &conn, const RouteParams &) { conn.runTask(conn.gzipBody(*pool)); },
+      [](HttpData &, const RouteParams &) { return SPBodySink(new SpoolBodySink(0)); });
+  // 其它路径都是静态文件
+  router.add(get, "/*", [](HttpData &conn, const RouteParams &) { conn.serveFile(); });
+  if (uploadsEnabled_) {
+    router.add(
+        Router::method(METHOD_PUT), "/*",
+        [](HttpData &conn, const RouteParams &) { conn.putFile(); },
+        [](HttpData &conn, const RouteParams &) -> SPBodySink {
+          if (escapesRoot(conn.fileName_)) return SPBodySink();
+          shared_ptr<FileBodySink> sink(new FileBodySink(conn.fileName_));
+          // 目录不存在或者没有写权限
+          if (!sink->valid()) return SPBodySink();
+          return sink;
+        });
+    router.add(Router::method(METHOD_DELETE), "/*",
+               [](HttpData &conn, const RouteParams &) { conn.deleteFile(); });
+  }
+}
+
+void HttpData::serveFile() {
+  // 路径只能落在网站根目录里
+  if (escapesRoot(fileName_)) {
+    appendError(403, false);
+    return;
+  }
+
+  // 条件请求：浏览器重新验证已经缓存的资源，没有变化时只回304头部，不需要打开文件
+  if ((headers_.has(HDR_IF_NONE_MATCH) || headers_.has(HDR_IF_MODIFIED_SINCE)) &&
+      appendNotModified())
+    return;
 
-    struct stat sbuf;
-    if (stat(fileName_.c_str(), &sbuf) < 0) {
-      header.clear();
-      handleError(fd_, 404, "Not Found!");
-      return ANALYSIS_ERROR;
+  // 断点续传/拖动进度条：只发送请求的那几段，文件段按偏移用sendfile发送，
+  // 请求大文件中的4KB只会读4KB；Range无效或If-Range不匹配时按普通请求处理
+  if (method_ == METHOD_GET && headers_.has(HDR_RANGE)) {
+    SPCachedFile file = FileCache::instance().get(fileName_);
+    if (!file) {
+      appendError(404, false);
+      return;
     }
-    header += "Content-Type: " + filetype + "\r\n";
-    header += "Content-Length: " + to_string(sbuf.st_size) + "\r\n";
-    header += "Server: LinYa's Web Server\r\n";
-    // 头部结束
-    header += "\r\n";
-    outBuffer_ += header;
-
-    if (method_ == METHOD_HEAD) return ANALYSIS_SUCCESS;
-
-    int src_fd = open(fileName_.c_str(), O_RDONLY, 0);
-    if (src_fd < 0) {
-      outBuffer_.clear();
-      handleError(fd_, 404, "Not Found!");
-      return ANALYSIS_ERROR;
+    if (appendRangeResponse(file)) return;
+  }
+
+  // 热点小文件的完整响应直接从内存发出：状态行是静态切片，其余部分借用缓存中的数据
+  // 客户端支持gzip时优先找压缩过的变体(它不是compressible的)
+  ResponseCache &responseCache = ResponseCache::instance();
+  uint64_t generation = responseCache.generation();
+  bool gzip = acceptsGzip();
+  SPCachedResponse response = responseCache.get(fileName_, gzip);
+  if (response && !(gzip && response->compressible)) {
+    appendCachedResponse(response);
+    return;
+  }
+
+  // 先检查文件再写响应头，出错时输出队列里不会残留半个响应
+  // 文件的stat结果、fd、MIME和头部字段都来自缓存，命中时不需要任何系统调用
+  SPCachedFile file = FileCache::instance().get(fileName_);
+  if (!file) {
+    // 不存在的文件只回错误页，连接照常保持，扫描器的大量请求不会反复建连
+    appendError(404, false);
+    return;
+  }
+  if (gzip && file->compressible) {
+    // 有预压缩的旁路文件就直接用，否则交给后台压缩，这次先返回未压缩的内容
+    if (appendGzipSidecar(file, generation)) return;
+    GzipCompressor::instance().request(fileName_, file, generation);
+  }
+  if (!response) response = responseCache.fill(fileName_, file, file->header, generation);
+  if (response) {
+    appendCachedResponse(response);
+    return;
+  }
+
+  Buffer &header = appendStatusLine();
+  header.append(file->header);
+  header.append("Server: LinYa's Web Server\r\n");
+  // 头部结束
+  header.append("\r\n");
+
+  if (method_ == METHOD_HEAD) return;
+
+  // 文件内容作为单独的一段排在头部之后，由输出队列用sendfile发送
+  // file作为anchor，保证发送完之前fd不会因为缓存淘汰而被关闭
+  output_.appendFile(file->fd, 0, file->st.st_size, file);
+}
+
+// echo test：请求体原样流式返回，大的请求体从临时文件里分块读
+void HttpData::echoBody() {
+  shared_ptr<SpoolBodySink> body = dynamic_pointer_cast<SpoolBodySink>(bodySink_);
+  if (!body) body.reset(new SpoolBodySink(0));
+  SPBodySource source;
+  if (body->spooled()) {
+    source.reset(new FileBodySource(body->fd(), 0, body->size(), body));
+  } else {
+    size_t sent = 0;
+    source.reset(new GeneratorBodySource(
+        [body, sent](Buffer &buf, size_t maxBytes) mutable -> ssize_t {
+          const string &data = body->memory();
+          size_t n = min(maxBytes, data.size() - sent);
+          buf.append(data.data() + sent, n);
+          sent += n;
+          return n;
+        }));
+  }
+  appendStreamedResponse("Content-Type: application/octet-stream\r\n", source);
+}
+
+// 解析"bytes=0-499,1000-,-500"形式的Range，结果按请求中的顺序放进ranges(闭区间)
+// 语法错误、单位不是bytes、段数太多或者各段加起来比文件还大(大量重叠)时返回RANGE_IGNORE，
+// 按普通请求返回整个文件；没有一段落在文件内时返回RANGE_UNSATISFIABLE
+static const size_t kMaxRanges = 16;
+
+enum RangeState { RANGE_OK = 1, RANGE_IGNORE, RANGE_UNSATISFIABLE };
+
+static RangeState parseRange(const StringPiece &header, off_t size,
+                             vector<pair<off_t, off_t>> &ranges) {
+  if (!header.starts_with("bytes=")) return RANGE_IGNORE;
+  string value = header.as_string();
+  size_t pos = 6;
+  size_t specs = 0;
+  off_t total = 0;
+  while (pos <= value.size()) {
+    size_t end = value.find(',', pos);
+    if (end == string::npos) end = value.size();
+    size_t begin = value.find_first_not_of(' ', pos);
+    size_t last = value.find_last_not_of(' ', end - 1);
+    pos = end + 1;
+    if (begin >= end || last == string::npos || last < begin) continue;
+    if (++specs > kMaxRanges) return RANGE_IGNORE;
+
+    string spec = value.substr(begin, last - begin + 1);
+    size_t dash = spec.find('-');
+    if (dash == string::npos ||
+        spec.find_first_not_of("0123456789-") != string::npos ||
+        spec.find('-', dash + 1) != string::npos)
+      return RANGE_IGNORE;
+    string firstStr = spec.substr(0, dash), lastStr = spec.substr(dash + 1);
+    if (firstStr.empty() && lastStr.empty()) return RANGE_IGNORE;
+    // 数字太长会溢出，按无效处理
+    if (firstStr.size() > 18 || lastStr.size() > 18) return RANGE_IGNORE;
+
+    off_t first, lastByte;
+    if (firstStr.empty()) {
+      // 最后N个字节
+      off_t suffix = atoll(lastStr.c_str());
+      if (suffix == 0 || size == 0) continue;
+      first = suffix >= size ? 0 : size - suffix;
+      lastByte = size - 1;
+    } else {
+      first = atoll(firstStr.c_str());
+      lastByte = lastStr.empty() ? size - 1 : atoll(lastStr.c_str());
+      if (!lastStr.empty() && lastByte < first) return RANGE_IGNORE;
+      if (first >= size) continue;
+      if (lastByte >= size) lastByte = size - 1;
     }
-    void *mmapRet = mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, src_fd, 0);
-    close(src_fd);
-    if (mmapRet == (void *)-1) {
-      munmap(mmapRet, sbuf.st_size);
-      outBuffer_.clear();
-      handleError(fd_, 404, "Not Found!");
-      return ANALYSIS_ERROR;
+    total += lastByte - first + 1;
+    if (total > size) return RANGE_IGNORE;
+    ranges.push_back(make_pair(first, lastByte));
+  }
+  if (specs == 0) return RANGE_IGNORE;
+  return ranges.empty() ? RANGE_UNSATISFIABLE : RANGE_OK;
+}
+
+// 多段响应的分隔符，进程内固定，由启动时间和pid生成，不会和文件内容撞上
+static const string &byteRangesBoundary() {
+  static const string boundary = [] {
+    char buf[40];
+    snprintf(buf, sizeof buf, "LinYa%08lx%08x", static_cast<unsigned long>(time(NULL)),
+             static_cast<unsigned>(getpid()));
+    return string(buf);
+  }();
+  return boundary;
+}
+
+// 请求体压缩成gzip返回，压缩在计算线程池里做，完成后回到这里接着写响应
+Task<> HttpData::gzipBody(ThreadPool &pool) {
+  shared_ptr<SpoolBodySink> body = dynamic_pointer_cast<SpoolBodySink>(bodySink_);
+  if (!body) body.reset(new SpoolBodySink(0));
+  if (body->size() > GzipCompressor::kMaxSourceSize) {
+    appendError(413, false);
+    co_return;
+  }
+  shared_ptr<string> out(new string);
+  bool compressed = false;
+  // 带有非平凡析构成员的临时对象不直接写在co_await表达式里(GCC 12会把它析构两次)，先存到变量里
+  auto compress = loop_->compute(pool, [body, out, &compressed]() {
+    compressed = GzipCompressor::compress(body->fd(), body->size(), *out);
+  });
+  bool submitted = co_await compress;
+  if (!submitted) {
+    LOG << "compute pool " << pool.name() << " is full, shedding " << path_;
+    appendError(503, false);
+    co_return;
+  }
+  if (!compressed) {
+    appendError(500, false);
+    co_return;
+  }
+  Buffer &header = appendStatusLine();
+  header.append("Content-Type: application/gzip\r\n");
+  header.append("Content-Length: " + to_string(out->size()) + "\r\n");
+  header.append("Server: LinYa's Web Server\r\n\r\n");
+  output_.appendSlice(out->data(), out->size(), out);
+}
+
+// 请求体已经写进临时文件并且rename成了目标文件，这里只回复结果
+void HttpData::putFile() {
+  shared_ptr<FileBodySink> sink = static_pointer_cast<FileBodySink>(bodySink_);
+  Buffer &header = output_.headerBlock();
+  if (sink->created()) {
+    appendStatusLine(header, "201 Created");
+    header.append("Content-Length: 0\r\n");
+  } else {
+    appendStatusLine(header, "204 No Content");
+  }
+  header.append("Server: LinYa's Web Server\r\n\r\n");
+}
+
+void HttpData::deleteFile() {
+  if (escapesRoot(fileName_)) {
+    appendError(403, false);
+    return;
+  }
+  // 缓存中的条目由inotify通知失效
+  if (unlink(fileName_.c_str()) < 0) {
+    appendError(errno == ENOENT ? 404 : 403, false);
+    return;
+  }
+  Buffer &header = output_.headerBlock();
+  appendStatusLine(header, "204 No Content");
+  header.append("Server: LinYa's Web Server\r\n\r\n");
+}
+
+// 返回206(单段或multipart/byteranges)或416；返回false表示应忽略Range，按普通请求处理
+bool HttpData::appendRangeResponse(const SPCachedFile &file) {
+  // If-Range带的校验值和文件当前的不一致，说明客户端手里的部分已经过时，要整个重新下载
+  // 实体标签要强比较(弱标签一律不匹配)，否则是日期，要和Last-Modified完全一致
+  if (headers_.has(HDR_IF_RANGE)) {
+    StringPiece validator = headers_.get(HDR_IF_RANGE);
+    const string &expected =
+        validator.starts_with("\"") ? file->etag : file->lastModified;
+    if (validator != StringPiece(expected)) return false;
+  }
+
+  const off_t size = file->st.st_size;
+  vector<pair<off_t, off_t>> ranges;
+  RangeState state = parseRange(headers_.get(HDR_RANGE), size, ranges);
+  if (state == RANGE_IGNORE) return false;
+
+  Buffer &header = output_.headerBlock();
+  if (state == RANGE_UNSATISFIABLE) {
+    appendStatusLine(header, "416 Range Not Satisfiable");
+    header.append("Content-Range: bytes */" + to_string(size) + "\r\n");
+    header.append("Content-Length: 0\r\n");
+    header.append("Server: LinYa's Web Server\r\n\r\n");
+    return true;
+  }
+
+  appendStatusLine(header, "206 Partial Content");
+  header.append("Last-Modified: " + file->lastModified + "\r\n");
+  // 和200响应一样带上ETag，续传时客户端用它做If-Range校验已经拿到的部分
+  header.append("ETag: " + file->etag + "\r\n");
+  header.append("Accept-Ranges: bytes\r\n");
+  if (file->compressible) header.append("Vary: Accept-Encoding\r\n");
+  header.append("Server: LinYa's Web Server\r\n");
+  if (ranges.size() == 1) {
+    off_t first = ranges[0].first, last = ranges[0].second;
+    header.append("Content-Type: " + file->mime + "\r\n");
+    header.append("Content-Range: bytes " + to_string(first) + "-" +
+                  to_string(last) + "/" + to_string(size) + "\r\n");
+    header.append("Content-Length: " + to_string(last - first + 1) + "\r\n\r\n");
+    output_.appendFile(file->fd, first, last - first + 1, file);
+    return true;
+  }
+
+  // 每段前面是分隔符和这一段的头部，段内容仍然是文件段；先拼好各段的头部以算出总长度
+  const string &boundary = byteRangesBoundary();
+  vector<string> partHeaders;
+  size_t length = 0;
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    string part = "\r\n--" + boundary + "\r\n";
+    part += "Content-Type: " + file->mime + "\r\n";
+    part += "Content-Range: bytes " + to_string(ranges[i].first) + "-" +
+            to_string(ranges[i].second) + "/" + to_string(size) + "\r\n\r\n";
+    length += part.size() + (ranges[i].second - ranges[i].first + 1);
+    partHeaders.push_back(part);
+  }
+  const string tail = "\r\n--" + boundary + "--\r\n";
+  length += tail.size();
+  header.append("Content-Type: multipart/byteranges; boundary=" + boundary + "\r\n");
+  header.append("Content-Length: " + to_string(length) + "\r\n\r\n");
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    output_.append(partHeaders[i]);
+    output_.appendFile(file->fd, ranges[i].first,
+                       ranges[i].second - ranges[i].first + 1, file);
+  }
+  output_.append(tail);
+  return true;
+}
+
+// If-None-Match中是否有和etag弱比较相等的标签(或者*)
+static bool etagMatches(const StringPiece &header, const string &etag) {
+  StringPiece target(etag);
+  if (target.starts_with("W/")) target.remove_prefix(2);
+  const char *p = header.begin();
+  while (p < header.end()) {
+    const char *comma = std::find(p, header.end(), ',');
+    StringPiece tag = trim(p, comma);
+    p = comma + 1;
+    if (tag == "*") return true;
+    if (tag.starts_with("W/")) tag.remove_prefix(2);
+    if (tag == target) return true;
+  }
+  return false;
+}
+
+// 有If-None-Match时只看它，否则看If-Modified-Since；返回true表示已经回了304
+bool HttpData::appendNotModified() {
+  FileValidators v;
+  if (!FileCache::instance().validators(fileName_, v)) return false;
+  // 可压缩的文件有两种表示，客户端手里的可能是gzip变体
+  string gzipETag = v.compressible ? GzipCompressor::gzipETag(v.etag) : string();
+  const string *etag = NULL;
+  if (headers_.has(HDR_IF_NONE_MATCH)) {
+    StringPiece inm = headers_.get(HDR_IF_NONE_MATCH);
+    if (etagMatches(inm, v.etag))
+      etag = &v.etag;
+    else if (v.compressible && etagMatches(inm, gzipETag))
+      etag = &gzipETag;
+    else
+      return false;
+  } else {
+    StringPiece ims = headers_.get(HDR_IF_MODIFIED_SINCE);
+    time_t since;
+    if (ims != StringPiece(v.lastModified) &&
+        !(parseHttpDate(ims.data(), ims.size(), since) && v.mtime <= since))
+      return false;
+    etag = v.compressible && acceptsGzip() ? &gzipETag : &v.etag;
+  }
+
+  Buffer &header = output_.headerBlock();
+  appendStatusLine(header, "304 Not Modified");
+  header.append("ETag: " + *etag + "\r\n");
+  header.append("Last-Modified: " + v.lastModified + "\r\n");
+  if (v.compressible) header.append("Vary: Accept-Encoding\r\n");
+  header.append("Server: LinYa's Web Server\r\n\r\n");
+  return true;
+}
+
+// 缓存的响应借用给输出队列，response作为anchor保证发送完之前数据有效
+void HttpData::appendCachedResponse(const SPCachedResponse &response) {
+  appendStatusLine();
+  size_t len = method_ == METHOD_HEAD ? response->headerLength
+                                      : response->data.size();
+  output_.appendSlice(response->data.data(), len, response);
+}
+
+// 发送预压缩的file.gz，它必须比原文件新，否则视为过期
+bool HttpData::appendGzipSidecar(const SPCachedFile &file, uint64_t generation) {
+  SPCachedFile gz = FileCache::instance().get(fileName_ + ".gz");
+  if (!gz || gz->st.st_mtime < file->st.st_mtime) return false;
+  string fields = GzipCompressor::gzipHeader(*file, gz->st.st_size);
+  SPCachedResponse response = ResponseCache::instance().fill(
+      ResponseCache::gzipKey(fileName_), gz, fields, generation);
+  if (response) {
+    appendCachedResponse(response);
+    return true;
+  }
+  Buffer &header = appendStatusLine();
+  header.append(fields);
+  header.append("Server: LinYa's Web Server\r\n\r\n");
+  if (method_ != METHOD_HEAD) output_.appendFile(gz->fd, 0, gz->st.st_size, gz);
+  return true;
+}
+
+// Accept-Encoding中是否有q值不为0的gzip(或*)
+bool HttpData::acceptsGzip() {
+  StringPiece value = headers_.get(HDR_ACCEPT_ENCODING);
+  const char *p = value.begin();
+  while (p < value.end()) {
+    const char *comma = std::find(p, value.end(), ',');
+    const char *semi = std::find(p, comma, ';');
+    StringPiece name = trim(p, semi);
+    p = comma + 1;
+    if (!name.equalsIgnoreCase("gzip") && name != "*") continue;
+    if (semi < comma) {
+      // 值后面总是跟着CRLF，strtod不会越界
+      const char *q = std::search(semi, comma, "q=", "q=" + 2);
+      if (q < comma && strtod(q + 2, NULL) == 0) return false;
     }
-    char *src_addr = static_cast<char *>(mmapRet);
-    outBuffer_ += string(src_addr, src_addr + sbuf.st_size);
-    ;
-    munmap(mmapRet, sbuf.st_size);
-    return ANALYSIS_SUCCESS;
+    return true;
   }
-  return ANALYSIS_ERROR;
+  return false;
 }
 
-void HttpData::handleError(int fd, int err_num, string short_msg) {
-  short_msg = " " + short_msg;
-  char send_buff[4096];
-  string body_buff, header_buff;
-  body_buff += "<html><title>哎~出错了</title>";
-  body_buff += "<body bgcolor=\"ffffff\">";
-  body_buff += to_string(err_num) + short_msg;
-  body_buff += "<hr><em> LinYa's Web Server</em>\n</body></html>";
+// 长度事先未知的响应：HTTP/1.1用chunked编码，HTTP/1.0靠发完后关闭连接表示结束
+void HttpData::appendStreamedResponse(const string &fields, const SPBodySource &source) {
+  bool chunked = HTTPVersion_ == HTTP_11;
+  if (!chunked) keepAlive_ = false;
+  Buffer &header = appendStatusLine();
+  header.append(fields);
+  if (chunked) {
+    header.append("Transfer-Encoding: chunked\r\n");
+  } else {
+    // 发完这个响应就关闭连接，后面的请求不再处理
+    header.append("Connection: Close\r\n");
+    error_ = true;
+    connectionState_ = H_DISCONNECTING;
+  }
+  header.append("Server: LinYa's Web Server\r\n\r\n");
+  if (method_ == METHOD_HEAD) return;
+  // 数据源在socket可写时才被调用，边生成边发送
+  output_.appendSource(chunked ? SPBodySource(new ChunkedBodySource(source)) : source);
+}
+
+// 状态行和连接相关的头部，只有两种取值，预先生成好，作为静态切片发送
+Buffer &HttpData::appendStatusLine() {
+  static const string statusLine = "HTTP/1.1 200 OK\r\n";
+  static const string statusLineKeepAlive = statusLine + keepAliveFields();
+  const string &line = keepAlive_ ? statusLineKeepAlive : statusLine;
+  output_.appendSlice(line.data(), line.size());
+  // 之后的头部字段接着写在Date后面
+  Buffer &header = output_.headerBlock();
+  appendDate(header);
+  return header;
+}
+
+// 不常见的状态码，状态行和连接头部直接写进头部块
+void HttpData::appendStatusLine(Buffer &header, const char *status) {
+  header.append("HTTP/1.1 ");
+  header.append(status, strlen(status));
+  header.append("\r\n", 2);
+  appendDate(header);
+  if (keepAlive_) header.append(keepAliveFields());
+}
 
-  header_buff += "HTTP/1.1 " + to_string(err_num) + short_msg + "\r\n";
-  header_buff += "Content-Type: text/html\r\n";
-  header_buff += "Connection: Close\r\n";
-  header_buff += "Content-Length: " + to_string(body_buff.size()) + "\r\n";
-  header_buff += "Server: LinYa's Web Server\r\n";
-  ;
-  header_buff += "\r\n";
-  // 错误处理不考虑writen不完的情况
-  sprintf(send_buff, "%s", header_buff.c_str());
-  writen(fd, send_buff, strlen(send_buff));
-  sprintf(send_buff, "%s", body_buff.c_str());
-  writen(fd, send_buff, strlen(send_buff));
+// Date头部取本线程缓存的字符串，每秒最多格式化一次；要拷贝，不能借用
+void HttpData::appendDate(Buffer &header) {
+  StringPiece date = CachedClock::httpDate();
+  header.append("Date: ", 6);
+  header.append(date.data(), date.size());
+  header.append("\r\n", 2);
+}
+
+void HttpData::handleError(int code) {
+  error_ = true;
+  connectionState_ = H_DISCONNECTING;
+  inBuffer_.retrieveAll();
+  nowReadPos_ = 0;
+  // 排在已经生成的响应后面，保证顺序；发不完的部分等EPOLLOUT接着发，发完才关闭
+  appendError(code, true);
+  flushOutput();
+}
+
+void HttpData::appendError(int code, bool close) {
+  const ErrorPage &page = ErrorPages::get(code);
+  output_.appendSlice(page.statusLine.data(), page.statusLine.size());
+  Buffer &header = output_.headerBlock();
+  appendDate(header);
+  if (close)
+    header.append("Connection: Close\r\n");
+  else if (keepAlive_)
+    header.append(keepAliveFields());
+  // Allow列出这条路径上注册了的方法
+  if (code == 405) header.append("Allow: " + Router::methodNames(allowedMethods_) + "\r\n");
+  // 请求行解析失败时method_是上一个请求的，这时总是带上正文
+  size_t len = !close && method_ == METHOD_HEAD ? page.headerLength : page.tail.size();
+  output_.appendSlice(page.tail.data(), len);
 }
 
 void HttpData::handleClose() {
   connectionState_ = H_DISCONNECTED;
-  // shared_ptr<HttpData> guard(shared_from_this());
+  // 已经关过(比如出错关闭后定时器又到期)时什么也不做，fd这时还没有关，不会是别的连接的
+  SPHttpData self;
+  self.swap(self_);
+  if (!self) return;
   loop_->removeFromPoller(channel_);
-
+  // 调用者可能还在这个连接的处理函数里，放到本轮事件处理完之后再释放
+  loop_->queueInLoop([self]() {});
 }
 
 void HttpData::newEvent() {
+  // 注册在poller上期间连接由自己持有，handleClose时释放
+  self_ = SPHttpData(this);
   channel_->setEvents(DEFAULT_EVENT);
   loop_->addToPoller(channel_, DEFAULT_EXPIRED_TIME);
 }
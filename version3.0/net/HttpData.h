@@ -3,12 +3,22 @@
 #pragma once
 #include <sys/epoll.h>
 #include <unistd.h>
+#include <atomic>
 #include <functional>
-#include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include "BodySink.h"
+#include "Buffer.h"
+#include "ChunkedCodec.h"
+#include "Coroutine.h"
+#include "HttpHeaders.h"
+#include "OutputQueue.h"
+#include "ResponseCache.h"
+#include "Router.h"
 #include "Timer.h"
+#include "../base/IntrusivePtr.h"
+#include "../base/ThreadPool.h"
 
 
 class EventLoop;
@@ -27,31 +37,28 @@ enum URIState {
   PARSE_URI_AGAIN = 1,
   PARSE_URI_ERROR,
   PARSE_URI_SUCCESS,
+  PARSE_URI_TOO_LONG,
+  PARSE_URI_BAD_METHOD
 };
 
 enum HeaderState {
   PARSE_HEADER_SUCCESS = 1,
   PARSE_HEADER_AGAIN,
-  PARSE_HEADER_ERROR
+  PARSE_HEADER_ERROR,
+  PARSE_HEADER_TOO_LARGE
 };
 
-enum AnalysisState { ANALYSIS_SUCCESS = 1, ANALYSIS_ERROR };
-
-enum ParseState {
-  H_START = 0,
-  H_KEY,
-  H_COLON,
-  H_SPACES_AFTER_COLON,
-  H_VALUE,
-  H_CR,
-  H_LF,
-  H_END_CR,
-  H_END_LF
+enum BodyState {
+  BODY_AGAIN = 1,
+  BODY_ERROR,
+  BODY_TOO_LARGE,
+  BODY_SINK_ERROR,
+  BODY_SUCCESS
 };
 
-enum ConnectionState { H_CONNECTED = 0, H_DISCONNECTING, H_DISCONNECTED };
+enum AnalysisState { ANALYSIS_SUCCESS = 1, ANALYSIS_ERROR };
 
-enum HttpMethod { METHOD_POST = 1, METHOD_GET, METHOD_HEAD };
+enum ConnectionState { H_CONNECTED = 0, H_DISCONNECTING, H_DISCONNECTED };
 
 enum HttpVersion { HTTP_10 = 1, HTTP_11 };
 
@@ -69,27 +76,83 @@ class MimeType {
   static pthread_once_t once_control;
 };
 
-class HttpData : public std::enable_shared_from_this<HttpData> {
+class HttpData;
+typedef IntrusivePtr<HttpData> SPHttpData;
+
+class HttpData {
  public:
-  HttpData(EventLoop *loop, int connfd);
   ~HttpData() { close(fd_); }
+  // 在loop的线程里调用：优先从本线程的空闲链表里取一个关闭过的连接对象复用，
+  // Channel、绑定好的回调、缓冲区和字符串的容量都跟着复用，短连接多时基本不用再分配内存
+  static SPHttpData create(EventLoop *loop, int connfd, const Router *router);
+  // 本线程空闲链表里最多保留的连接对象数
+  static const size_t kMaxFreeConnections = 4096;
+
+  // 引用计数，给SPHttpData用；归零时在所属loop的线程里放回空闲链表
+  void retain() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  void release();
+
   void reset();
   void seperateTimer();
-  void linkTimer(std::shared_ptr<TimerNode> mtimer) {
-    // shared_ptr重载了bool, 但weak_ptr没有
-    timer_ = mtimer;
-  }
+  // 连接的超时定时器，嵌在连接里，由所在loop的时间轮挂上/摘下，到期时关闭连接
+  TimerNode *getTimer() { return &timer_; }
   std::shared_ptr<Channel> getChannel() { return channel_; }
   EventLoop *getLoop() { return loop_; }
   void handleClose();
   void newEvent();
 
+  // 一个连接上最多有多少个请求的响应还没发完，达到上限时暂停处理管线中的后续请求
+  static void setMaxPipelinedRequests(int n) { maxPipelinedRequests_ = n > 0 ? n : 1; }
+  static const int kDefaultMaxPipelinedRequests = 16;
+  // 是否允许PUT/DELETE修改网站目录下的文件，默认不允许；要在registerRoutes之前设置
+  static void setUploadsEnabled(bool on) { uploadsEnabled_ = on; }
+  // 内置的路由：/hello、/favicon.ico、POST /echo、POST /gzip(在computePool里压缩)、
+  // 其它路径都是静态文件，开启上传时还有PUT/DELETE
+  static void registerRoutes(Router &router, ThreadPool &computePool);
+
+  // 以下给路由的处理函数用
+  HttpMethod method() const { return method_; }
+  // 请求的路径(不含查询串)，以及去掉开头的'/'之后对应的文件名("/"对应index.html)
+  const std::string &path() const { return path_; }
+  const std::string &fileName() const { return fileName_; }
+  const HttpHeaders &headers() const { return headers_; }
+  // 请求体的去处，由路由的SinkFactory创建，请求没有请求体时为空
+  const SPBodySink &bodySink() const { return bodySink_; }
+  OutputQueue &output() { return output_; }
+  // 200状态行(静态切片)，返回紧跟其后、已写好Date的头部块，调用者接着写其它字段和结束头部的空行
+  Buffer &appendStatusLine();
+  // 其它状态码，status形如"201 Created"
+  void appendStatusLine(Buffer &header, const char *status);
+  // 错误页排进输出队列，close为false时按keepAlive_保持连接
+  void appendError(int code, bool close);
+  // 长度事先未知的响应：HTTP/1.1用chunked编码，HTTP/1.0靠发完后关闭连接表示结束
+  void appendStreamedResponse(const std::string &fields, const SPBodySource &source);
+
+  // 计算完成后在连接所属的loop上执行，写这个请求的响应
+  typedef std::function<void(HttpData &)> Completion;
+  typedef std::function<Completion()> Work;
+  // 耗CPU的处理交给pool：work在计算线程里执行，不能访问HttpData，需要的请求数据先拷贝进去；
+  // 它返回的Completion回到本连接的loop上执行(返回空时回500)。在此之前连接暂停：
+  // 不读socket，也不处理后面的管线请求。pool的队列满时直接回503
+  void offload(ThreadPool &pool, const Work &work);
+  // 协程写的处理函数：task在本连接的loop上运行，可以co_await EventLoop上的等待原语，
+  // 直接写响应；在它结束之前连接同样暂停，抛出异常时回500并关闭连接。例如
+  //   router.add(m, "/x", [](HttpData &conn, const RouteParams &) { conn.runTask(handleX(conn)); });
+  void runTask(Task<> task);
+
  private:
+  HttpData(EventLoop *loop, int connfd, const Router *router);
+  // 重新用于一个新连接/关闭后放回空闲链表前清理
+  void open(int connfd, const Router *router);
+  void recycle();
+
+  std::atomic<int> refs_;
   EventLoop *loop_;
   std::shared_ptr<Channel> channel_;
   int fd_;
-  std::string inBuffer_;
-  std::string outBuffer_;
+  Buffer inBuffer_;
+  // 待发送的响应：头部、借用的只读切片、文件段，按顺序用writev/sendfile发送
+  OutputQueue output_;
   bool error_;
   ConnectionState connectionState_;
 
@@ -97,18 +160,57 @@ class HttpData : public std::enable_shared_from_this<HttpData> {
   HttpVersion HTTPVersion_;
   std::string fileName_;
   std::string path_;
-  int nowReadPos_;
+  size_t nowReadPos_; // 当前请求已经解析到inBuffer_中的位置
   ProcessState state_;
-  ParseState hState_;
   bool keepAlive_;
-  std::map<std::string, std::string> headers_;
-  std::weak_ptr<TimerNode> timer_;
+  // 字段引用inBuffer_中的数据，必须在inBuffer_之后构造
+  HttpHeaders headers_;
+  // 头部收完就按方法和路径找到处理函数，请求体的去处也由它决定
+  const Router *router_;
+  const Router::Route *route_;
+  RouteParams params_;
+  int allowedMethods_; // 没找到路由时，这条路径接受的方法(405)，为0表示路径不存在(404)
+  // 请求体收到一段就交给bodySink_一段，随即从inBuffer_中删掉
+  SPBodySink bodySink_;
+  bool chunkedBody_;
+  size_t bodyRemaining_; // Content-Length时还没收到的字节数
+  ChunkedDecoder chunked_;
+  ChunkedDecoder::Slices body_; // chunked_每次解码出的数据块，交给bodySink_后清空
+  HttpHeaders trailers_;
+  int inFlight_; // 已经处理完、响应还没有全部发出的请求数
+  bool parked_;  // 当前请求在计算线程池里，等结果回来
+  TimerNode timer_;
+  SPHttpData self_;
+
+  static int maxPipelinedRequests_;
+  static bool uploadsEnabled_;
 
   void handleRead();
   void handleWrite();
+  void flushOutput();
+  int processRequests();
+  int beginBody();
+  BodyState receiveBody();
+  bool pipelineBlocked() const;
   void handleConn();
-  void handleError(int fd, int err_num, std::string short_msg);
+  void resume(const Completion &done);
+  void finishParked();
+  // 无法继续处理的错误：回复错误页，不再读后面的请求，发送完再关闭连接
+  void handleError(int code);
+  void appendDate(Buffer &header);
+  bool appendRangeResponse(const SPCachedFile &file);
+  bool appendNotModified();
+  void appendCachedResponse(const SPCachedResponse &response);
+  bool appendGzipSidecar(const SPCachedFile &file, uint64_t generation);
+  bool acceptsGzip();
+  bool hasPendingOutput() const { return !output_.empty(); }
+  bool outputBackedUp() const;
   URIState parseURI();
   HeaderState parseHeaders();
   AnalysisState analysisRequest();
+  void serveFile();
+  void echoBody();
+  Task<> gzipBody(ThreadPool &pool);
+  void putFile();
+  void deleteFile();
 };
\ No newline at end of file
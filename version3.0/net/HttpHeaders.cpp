@@ -0,0 +1,76 @@
+#include "HttpHeaders.h"
+
+const size_t HttpHeaders::kInlineFields;
+
+namespace {
+struct KnownHeader {
+    const char *name;
+    size_t len;
+    HttpHeaderId id;
+};
+
+#define KNOWN_HEADER(name, id) { name, sizeof(name) - 1, id }
+const KnownHeader kKnownHeaders[] = {
+    KNOWN_HEADER("Host", HDR_HOST),
+    KNOWN_HEADER("Connection", HDR_CONNECTION),
+    KNOWN_HEADER("Content-Length", HDR_CONTENT_LENGTH),
+    KNOWN_HEADER("Transfer-Encoding", HDR_TRANSFER_ENCODING),
+    KNOWN_HEADER("Expect", HDR_EXPECT),
+    KNOWN_HEADER("Accept-Encoding", HDR_ACCEPT_ENCODING),
+    KNOWN_HEADER("Range", HDR_RANGE),
+    KNOWN_HEADER("If-Range", HDR_IF_RANGE),
+    KNOWN_HEADER("If-None-Match", HDR_IF_NONE_MATCH),
+    KNOWN_HEADER("If-Modified-Since", HDR_IF_MODIFIED_SINCE),
+};
+#undef KNOWN_HEADER
+}
+
+HttpHeaders::HttpHeaders(const Buffer &buf) : buf_(buf), size_(0) {
+    for (int i = 0; i < HDR_COUNT; ++i) index_[i] = -1;
+}
+
+HttpHeaderId HttpHeaders::lookupId(const char *name, size_t len) {
+    // 表很小，先比长度，长度相同的才做一次大小写不敏感比较
+    for (size_t i = 0; i < sizeof kKnownHeaders / sizeof kKnownHeaders[0]; ++i)
+        if (kKnownHeaders[i].len == len && strncasecmp(kKnownHeaders[i].name, name, len) == 0)
+            return kKnownHeaders[i].id;
+    return HDR_OTHER;
+}
+
+void HttpHeaders::add(size_t nameOffset, size_t nameLen, size_t valueOffset, size_t valueLen) {
+    Field f;
+    f.id = static_cast<uint8_t>(lookupId(buf_.peek() + nameOffset, nameLen));
+    f.nameOffset = static_cast<uint32_t>(nameOffset);
+    f.nameLen = static_cast<uint32_t>(nameLen);
+    f.valueOffset = static_cast<uint32_t>(valueOffset);
+    f.valueLen = static_cast<uint32_t>(valueLen);
+    // 同名头部出现多次时按第一次出现的为准
+    if (f.id != HDR_OTHER && index_[f.id] < 0) index_[f.id] = static_cast<int>(size_);
+    if (size_ < kInlineFields)
+        inline_[size_] = f;
+    else
+        overflow_.push_back(f);
+    ++size_;
+}
+
+StringPiece HttpHeaders::get(HttpHeaderId id) const {
+    if (index_[id] < 0) return StringPiece();
+    return value(field(index_[id]));
+}
+
+StringPiece HttpHeaders::get(const StringPiece &name) const {
+    HttpHeaderId id = lookupId(name.data(), name.size());
+    if (id != HDR_OTHER) return get(id);
+    for (size_t i = 0; i < size_; ++i) {
+        const Field &f = field(i);
+        if (f.id == HDR_OTHER && this->name(f).equalsIgnoreCase(name)) return value(f);
+    }
+    return StringPiece();
+}
+
+void HttpHeaders::clear() {
+    if (size_ == 0) return;
+    size_ = 0;
+    overflow_.clear();
+    for (int i = 0; i < HDR_COUNT; ++i) index_[i] = -1;
+}
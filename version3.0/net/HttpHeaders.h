@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "Buffer.h"
+#include "../base/StringPiece.h"
+#include "../base/noncopyable.h"
+
+// 处理请求时会用到的头部，解析时把名字归一成编号，之后按编号查找不需要比较字符串
+enum HttpHeaderId {
+    HDR_OTHER = 0,
+    HDR_HOST,
+    HDR_CONNECTION,
+    HDR_CONTENT_LENGTH,
+    HDR_TRANSFER_ENCODING,
+    HDR_EXPECT,
+    HDR_ACCEPT_ENCODING,
+    HDR_RANGE,
+    HDR_IF_RANGE,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_COUNT
+};
+
+// 一个请求的头部表：每个字段只记录名字和值在输入缓冲区中的位置，不拷贝字符串
+// - 位置是相对于Buffer::peek()的偏移而不是指针，读入更多数据时Buffer可能挪动或扩容，
+//   只要请求处理完之前不retrieve，偏移一直有效；取值时再换算成StringPiece
+// - 字段放在对象内部的定长数组里，常见的请求不需要分配内存，超出的部分放进vector
+// - 已知头部按编号直接定位到第一次出现的位置；其它头部按名字大小写不敏感地线性查找
+class HttpHeaders : noncopyable {
+public:
+    explicit HttpHeaders(const Buffer &buf);
+
+    // 名字大小写不敏感地归一成编号，不认识的返回HDR_OTHER
+    static HttpHeaderId lookupId(const char *name, size_t len);
+
+    // 添加一个字段，参数是相对于buf.peek()的偏移
+    void add(size_t nameOffset, size_t nameLen, size_t valueOffset, size_t valueLen);
+    bool has(HttpHeaderId id) const { return index_[id] >= 0; }
+    // 不存在时返回空
+    StringPiece get(HttpHeaderId id) const;
+    StringPiece get(const StringPiece &name) const;
+    size_t size() const { return size_; }
+    void clear();
+
+    static const size_t kInlineFields = 16;
+
+private:
+    struct Field {
+        uint8_t id;
+        uint32_t nameOffset;
+        uint32_t nameLen;
+        uint32_t valueOffset;
+        uint32_t valueLen;
+    };
+    const Field &field(size_t i) const { return i < kInlineFields ? inline_[i] : overflow_[i - kInlineFields]; }
+    StringPiece name(const Field &f) const { return StringPiece(buf_.peek() + f.nameOffset, f.nameLen); }
+    StringPiece value(const Field &f) const { return StringPiece(buf_.peek() + f.valueOffset, f.valueLen); }
+
+    const Buffer &buf_;
+    Field inline_[kInlineFields];
+    std::vector<Field> overflow_;
+    size_t size_;
+    int index_[HDR_COUNT];
+};
@@ -0,0 +1,142 @@
+#include "HttpScanner.h"
+#include <stddef.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCANNER_X86 1
+#endif
+
+namespace {
+
+// 逐字节查表，表中为1的字节是要找的字符
+struct CharTable {
+    bool ctl[256];
+    bool nameEnd[256];
+    CharTable() {
+        for (int c = 0; c < 256; ++c) {
+            ctl[c] = (c < 0x20 && c != '\t') || c == 0x7f;
+            nameEnd[c] = c <= 0x20 || c == ':' || c == 0x7f;
+        }
+    }
+};
+const CharTable kTable;
+
+inline const char *scanScalar(const bool *table, const char *p, const char *end) {
+    while (p < end && !table[static_cast<unsigned char>(*p)]) ++p;
+    return p;
+}
+
+const char *findControlCharScalar(const char *begin, const char *end) {
+    return scanScalar(kTable.ctl, begin, end);
+}
+
+const char *findHeaderNameEndScalar(const char *begin, const char *end) {
+    return scanScalar(kTable.nameEnd, begin, end);
+}
+
+#ifdef HTTP_SCANNER_X86
+// SSE4.2: pcmpestri的range模式，一条指令判断16个字节是否落在若干个区间内
+// 每两个字节是一个闭区间
+__attribute__((target("sse4.2")))
+const char *scanRangesSse42(const char *ranges, int rangesLen, const bool *table,
+                            const char *p, const char *end) {
+    const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ranges));
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int idx = _mm_cmpestri(r, rangesLen, v, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (idx != 16) return p + idx;
+        p += 16;
+    }
+    // 不足16字节的尾部逐字节处理，避免读到缓冲区外面
+    return scanScalar(table, p, end);
+}
+
+const char kCtlRanges[16] = "\x00\x08\x0a\x1f\x7f\x7f";
+const char kNameEndRanges[16] = "\x00\x20::\x7f\x7f";
+
+const char *findControlCharSse42(const char *begin, const char *end) {
+    return scanRangesSse42(kCtlRanges, 6, kTable.ctl, begin, end);
+}
+
+const char *findHeaderNameEndSse42(const char *begin, const char *end) {
+    return scanRangesSse42(kNameEndRanges, 6, kTable.nameEnd, begin, end);
+}
+
+// AVX2: 一次32字节，无符号的c <= x用min(c, x) == c判断
+__attribute__((target("avx2")))
+const char *findControlCharAvx2(const char *p, const char *end) {
+    const __m256i x1f = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, x1f), v);
+        ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), ctl);
+        ctl = _mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, del));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(ctl));
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return scanScalar(kTable.ctl, p, end);
+}
+
+__attribute__((target("avx2")))
+const char *findHeaderNameEndAvx2(const char *p, const char *end) {
+    const __m256i space = _mm256_set1_epi8(0x20);
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i stop = _mm256_cmpeq_epi8(_mm256_min_epu8(v, space), v);
+        stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, colon));
+        stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, del));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(stop));
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return scanScalar(kTable.nameEnd, p, end);
+}
+#endif
+
+const HttpScanner kScalar = {findControlCharScalar, findHeaderNameEndScalar, "scalar"};
+#ifdef HTTP_SCANNER_X86
+const HttpScanner kSse42 = {findControlCharSse42, findHeaderNameEndSse42, "sse4.2"};
+const HttpScanner kAvx2 = {findControlCharAvx2, findHeaderNameEndAvx2, "avx2"};
+#endif
+
+HttpScanner pickScanner() {
+#ifdef HTTP_SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return kAvx2;
+    if (__builtin_cpu_supports("sse4.2")) return kSse42;
+#endif
+    return kScalar;
+}
+
+// 第一次使用时选定，之后不再变化
+const HttpScanner &scanner() {
+    static const HttpScanner s = pickScanner();
+    return s;
+}
+}
+
+const char *findControlChar(const char *begin, const char *end) {
+    return scanner().controlChar(begin, end);
+}
+
+const char *findHeaderNameEnd(const char *begin, const char *end) {
+    return scanner().headerNameEnd(begin, end);
+}
+
+const char *httpScannerName() { return scanner().name; }
+
+int availableHttpScanners(HttpScanner *out, int max) {
+    int n = 0;
+    if (n < max) out[n++] = kScalar;
+#ifdef HTTP_SCANNER_X86
+    __builtin_cpu_init();
+    if (n < max && __builtin_cpu_supports("sse4.2")) out[n++] = kSse42;
+    if (n < max && __builtin_cpu_supports("avx2")) out[n++] = kAvx2;
+#endif
+    return n;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// 解析请求时查找分隔符用的扫描函数，仿照picohttpparser一次比较16/32个字节：
+// 运行时用CPUID选择AVX2、SSE4.2或者逐字节查表的实现，编译时不需要-mavx2之类的选项
+// 两个函数都在[begin, end)中查找，找不到返回end
+
+// 第一个控制字符：'\t'以外的0x00-0x1f和0x7f。正常的行只会停在行尾的'\r'，
+// 停在别的字符上说明请求里有非法字符
+const char *findControlChar(const char *begin, const char *end);
+
+// 头部名字的结束位置：第一个':'、空格或者控制字符
+const char *findHeaderNameEnd(const char *begin, const char *end);
+
+// 当前使用的实现："avx2"、"sse4.2"或"scalar"
+const char *httpScannerName();
+
+// 一种实现的两个扫描函数
+struct HttpScanner {
+    const char *(*controlChar)(const char *begin, const char *end);
+    const char *(*headerNameEnd)(const char *begin, const char *end);
+    const char *name;
+};
+
+// 当前CPU上能用的所有实现(第一个总是scalar)，写进out，返回个数；测试里用来比较各实现的结果
+int availableHttpScanners(HttpScanner *out, int max);
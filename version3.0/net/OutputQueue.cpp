@@ -0,0 +1,226 @@
+#include "OutputQueue.h"
+#include <errno.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "Util.h"
+
+const size_t OutputQueue::kMaxIov;
+const size_t OutputQueue::kMaxFreeBlocks;
+const size_t OutputQueue::kMaxPooledBlockSize;
+const size_t OutputQueue::kSourceChunk;
+
+OutputQueue::OutputQueue() {}
+
+OutputQueue::~OutputQueue() { clear(); }
+
+std::unique_ptr<Buffer> OutputQueue::takeBlock() {
+    std::unique_ptr<Buffer> buf;
+    if (!freeBlocks_.empty()) {
+        buf = std::move(freeBlocks_.back());
+        freeBlocks_.pop_back();
+    } else {
+        buf.reset(new Buffer);
+    }
+    return buf;
+}
+
+OutputQueue::Segment &OutputQueue::newBufferSegment() {
+    Segment seg;
+    seg.type = SEG_BUFFER;
+    seg.buf = takeBlock();
+    segments_.push_back(std::move(seg));
+    return segments_.back();
+}
+
+Buffer &OutputQueue::headerBlock() { return *newBufferSegment().buf; }
+
+void OutputQueue::append(const char *data, size_t len) {
+    if (len == 0) return;
+    if (segments_.empty() || segments_.back().type != SEG_BUFFER) newBufferSegment();
+    segments_.back().buf->append(data, len);
+}
+
+void OutputQueue::appendOwned(Buffer &buf) {
+    if (buf.empty()) return;
+    newBufferSegment().buf->swap(buf);
+    buf.retrieveAll();
+}
+
+void OutputQueue::appendSlice(const char *data, size_t len, Anchor anchor) {
+    if (len == 0) return;
+    Segment seg;
+    seg.type = SEG_SLICE;
+    seg.data = data;
+    seg.len = len;
+    seg.anchor = std::move(anchor);
+    segments_.push_back(std::move(seg));
+}
+
+void OutputQueue::appendFile(int fd, off_t offset, size_t len, Anchor anchor) {
+    Segment seg;
+    seg.type = SEG_FILE;
+    seg.fd = fd;
+    seg.offset = offset;
+    seg.len = len;
+    seg.anchor = std::move(anchor);
+    if (len == 0) {
+        release(seg);
+        return;
+    }
+    segments_.push_back(std::move(seg));
+}
+
+void OutputQueue::appendSource(const SPBodySource &source) {
+    Segment seg;
+    seg.type = SEG_SOURCE;
+    seg.source = source;
+    segments_.push_back(std::move(seg));
+}
+
+size_t OutputQueue::pendingBytes() const {
+    size_t sum = 0;
+    for (std::deque<Segment>::const_iterator it = segments_.begin(); it != segments_.end(); ++it)
+        sum += it->type == SEG_SOURCE ? kSourceChunk : it->remaining();
+    return sum;
+}
+
+void OutputQueue::release(Segment &seg) {
+    if (seg.buf) {
+        seg.buf->retrieveAll();
+        // 特别大的块不回收，避免一次大响应之后长期占着内存
+        if (freeBlocks_.size() < kMaxFreeBlocks &&
+            seg.buf->writableBytes() <= kMaxPooledBlockSize)
+            freeBlocks_.push_back(std::move(seg.buf));
+        seg.buf.reset();
+    } else if (seg.type == SEG_FILE) {
+        if (!seg.anchor && seg.fd >= 0) close(seg.fd);
+        seg.fd = -1;
+    }
+    seg.anchor.reset();
+    seg.source.reset();
+}
+
+void OutputQueue::popFront() {
+    release(segments_.front());
+    segments_.pop_front();
+}
+
+void OutputQueue::clear() {
+    while (!segments_.empty()) popFront();
+}
+
+ssize_t OutputQueue::writeMemory(int sockfd, bool &again) {
+    struct iovec iov[kMaxIov];
+    int iovcnt = 0;
+    for (std::deque<Segment>::iterator it = segments_.begin();
+         it != segments_.end() && it->inMemory() && iovcnt < static_cast<int>(kMaxIov); ++it) {
+        size_t len = it->remaining();
+        if (len == 0) continue;
+        iov[iovcnt].iov_base = const_cast<char *>(it->type == SEG_BUFFER ? it->buf->peek() : it->data);
+        iov[iovcnt].iov_len = len;
+        ++iovcnt;
+    }
+    if (iovcnt == 0) {
+        // 队首都是空的内存块（例如申请了头部块却没有写入）
+        while (!segments_.empty() && segments_.front().inMemory() &&
+               segments_.front().remaining() == 0)
+            popFront();
+        return 0;
+    }
+
+    ssize_t n;
+    while ((n = writev(sockfd, iov, iovcnt)) < 0 && errno == EINTR) {}
+    if (n < 0) {
+        if (errno == EAGAIN) {
+            again = true;
+            return 0;
+        }
+        return -1;
+    }
+    if (n == 0) {
+        again = true;
+        return 0;
+    }
+
+    // 按写出的字节数推进各段，写完的段出队回收
+    size_t left = n;
+    while (!segments_.empty() && segments_.front().inMemory()) {
+        Segment &seg = segments_.front();
+        size_t len = seg.remaining();
+        if (left < len) {
+            if (seg.type == SEG_BUFFER) {
+                seg.buf->retrieve(left);
+            } else {
+                seg.data += left;
+                seg.len -= left;
+            }
+            break;
+        }
+        left -= len;
+        popFront();
+    }
+    return n;
+}
+
+ssize_t OutputQueue::writeFile(int sockfd, bool &again) {
+    Segment &seg = segments_.front();
+    size_t before = seg.len;
+    errno = 0;
+    if (sendfilen(sockfd, seg.fd, seg.offset, seg.len) < 0) {
+        // 文件所在的文件系统不支持sendfile，剩下的部分改成pread分块发送
+        if (errno != EINVAL && errno != ENOSYS) return -1;
+        seg.source.reset(new FileBodySource(seg.fd, seg.offset, seg.len, seg.anchor));
+        seg.type = SEG_SOURCE;
+        seg.fd = -1;
+        seg.anchor.reset();
+        return before - seg.len;
+    }
+    size_t sent = before - seg.len;
+    if (seg.len == 0)
+        popFront();
+    else
+        again = true;
+    return sent;
+}
+
+ssize_t OutputQueue::writeSource(int sockfd, bool &again) {
+    Segment &seg = segments_.front();
+    if (!seg.buf) seg.buf = takeBlock();
+    ssize_t sent = 0;
+    while (true) {
+        // 上一块发完了才要下一块
+        if (seg.buf->empty()) {
+            ssize_t n = seg.source->read(*seg.buf, kSourceChunk);
+            if (n < 0) return -1;
+            if (n == 0) {
+                popFront();
+                return sent;
+            }
+        }
+        ssize_t n;
+        while ((n = write(sockfd, seg.buf->peek(), seg.buf->readableBytes())) < 0 && errno == EINTR) {}
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                again = true;
+                return sent;
+            }
+            return -1;
+        }
+        seg.buf->retrieve(n);
+        sent += n;
+    }
+}
+
+ssize_t OutputQueue::flush(int sockfd) {
+    ssize_t sum = 0;
+    bool again = false;
+    while (!segments_.empty() && !again) {
+        Segment &front = segments_.front();
+        ssize_t n = front.type == SEG_FILE     ? writeFile(sockfd, again)
+                    : front.type == SEG_SOURCE ? writeSource(sockfd, again)
+                                               : writeMemory(sockfd, again);
+        if (n < 0) return -1;
+        sum += n;
+    }
+    return sum;
+}
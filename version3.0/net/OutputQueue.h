@@ -0,0 +1,86 @@
+#pragma once
+#include <sys/types.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BodySource.h"
+#include "Buffer.h"
+#include "../base/noncopyable.h"
+
+// 连接的输出队列：响应不再拼接成一整个string，而是按顺序排成若干段，
+// 每次可写时用一次writev把队首连续的内存段一起发出去（思路同version2.0的http_conn::write，
+// 只是推广到了任意多段）。段的类型有：
+// - 内存块(Buffer)：响应头和其它小块数据，块用完后回收到池里，下个响应复用
+// - 借用的只读切片：静态数据或缓存里的响应体，只记录指针和长度，不拷贝；
+//   anchor用来在发送完之前保持底层数据有效
+// - 文件段：[offset, offset+len)这一段文件内容，轮到它时用sendfile发送
+// - 数据源段：长度事先未知的流式响应体，轮到它且socket可写时才向BodySource要下一块，
+//   发完这一块再要下一块，内存占用与响应体大小无关
+// 部分写的情况下队列会记住发到了哪里，下次EPOLLOUT接着发
+
+class OutputQueue : noncopyable {
+public:
+    typedef std::shared_ptr<const void> Anchor;
+
+    OutputQueue();
+    ~OutputQueue();
+
+    // 在队尾开一个新的内存块（通常用来写响应头），返回的引用在该块发送完之前有效
+    Buffer &headerBlock();
+    // 拷贝数据到队尾的内存块，队尾不是内存块时新开一块
+    void append(const char *data, size_t len);
+    void append(const std::string &str) { append(str.data(), str.size()); }
+    // 接管buf中的数据（交换，不拷贝），之后buf为空
+    void appendOwned(Buffer &buf);
+    // 借用[data, data+len)，发送完之前调用者(或anchor)要保证数据有效
+    void appendSlice(const char *data, size_t len, Anchor anchor = Anchor());
+    // 发送文件fd的[offset, offset+len)；anchor为空时由队列负责关闭fd
+    void appendFile(int fd, off_t offset, size_t len, Anchor anchor = Anchor());
+    // 流式发送source产生的数据，直到它返回0
+    void appendSource(const SPBodySource &source);
+
+    // 尽可能多地把数据写到sockfd，遇到EAGAIN返回；出错返回-1
+    ssize_t flush(int sockfd);
+
+    bool empty() const { return segments_.empty(); }
+    // 待发送的字节数，长度未知的数据源按一块计
+    size_t pendingBytes() const;
+    void clear();
+
+    // 每次向数据源要的最大字节数
+    static const size_t kSourceChunk = 64 * 1024;
+
+private:
+    enum SegmentType { SEG_BUFFER, SEG_SLICE, SEG_FILE, SEG_SOURCE };
+    struct Segment {
+        SegmentType type;
+        std::unique_ptr<Buffer> buf;
+        const char *data;
+        int fd;
+        off_t offset;
+        size_t len;
+        Anchor anchor;
+        SPBodySource source; // SEG_SOURCE，buf中是已经取出还没发完的一块
+
+        Segment() : type(SEG_SLICE), data(NULL), fd(-1), offset(0), len(0) {}
+        size_t remaining() const { return type == SEG_BUFFER ? buf->readableBytes() : len; }
+        bool inMemory() const { return type == SEG_BUFFER || type == SEG_SLICE; }
+    };
+
+    std::unique_ptr<Buffer> takeBlock();
+    Segment &newBufferSegment();
+    void release(Segment &seg);
+    void popFront();
+    // 发送队首若干连续的内存段，返回写出的字节数
+    ssize_t writeMemory(int sockfd, bool &again);
+    ssize_t writeFile(int sockfd, bool &again);
+    ssize_t writeSource(int sockfd, bool &again);
+
+    std::deque<Segment> segments_;
+    std::vector<std::unique_ptr<Buffer>> freeBlocks_;
+
+    static const size_t kMaxIov = 64;
+    static const size_t kMaxFreeBlocks = 4;
+    static const size_t kMaxPooledBlockSize = 64 * 1024;
+};
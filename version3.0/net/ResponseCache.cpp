@@ -0,0 +1,238 @@
+#include "ResponseCache.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+pthread_once_t ResponseCache::once_control_ = PTHREAD_ONCE_INIT;
+ResponseCache *ResponseCache::instance_ = NULL;
+
+const char ResponseCache::kGzipSuffix[] = "\n;gzip";
+
+const size_t ResponseCache::kDefaultCapacity;
+const size_t ResponseCache::kDefaultMaxEntrySize;
+const size_t ResponseCache::kMaxTrackedChanges;
+
+ResponseCache &ResponseCache::instance() {
+    pthread_once(&once_control_, &ResponseCache::init);
+    return *instance_;
+}
+
+void ResponseCache::init() {
+    instance_ = new ResponseCache();
+    // 文件变化时FileCache会通知到这里
+    FileCache::instance().addInvalidateCallback(
+        std::bind(&ResponseCache::invalidate, instance_, std::placeholders::_1));
+}
+
+ResponseCache::ResponseCache()
+    : hand_(0),
+      bytes_(0),
+      capacity_(kDefaultCapacity),
+      maxEntrySize_(kDefaultMaxEntrySize),
+      generation_(0),
+      clearedAt_(0) {
+    memset(&stats_, 0, sizeof stats_);
+}
+
+SPCachedResponse ResponseCache::get(const std::string &path, bool acceptGzip) {
+    std::string gzKey;
+    if (acceptGzip) gzKey = gzipKey(path);
+    MutexLockGuard lock(mutex_);
+    std::unordered_map<std::string, size_t>::iterator it;
+    if (acceptGzip && (it = index_.find(gzKey)) != index_.end()) {
+        ++stats_.hits;
+        Slot &slot = slots_[it->second];
+        slot.referenced = true;
+        return slot.response;
+    }
+    it = index_.find(path);
+    if (it == index_.end()) {
+        ++stats_.misses;
+        return SPCachedResponse();
+    }
+    Slot &slot = slots_[it->second];
+    slot.referenced = true;
+    if (acceptGzip && slot.response->compressible)
+        ++stats_.misses;
+    else
+        ++stats_.hits;
+    return slot.response;
+}
+
+uint64_t ResponseCache::generation() const {
+    MutexLockGuard lock(mutex_);
+    return generation_;
+}
+
+SPCachedResponse ResponseCache::fill(const std::string &key, const SPCachedFile &file,
+                                     const std::string &header, uint64_t generation) {
+    size_t size = file->st.st_size;
+    // 收不到文件变化通知时无法保证缓存内容是新的
+    if (!FileCache::instance().watching()) return SPCachedResponse();
+    {
+        MutexLockGuard lock(mutex_);
+        if (size > maxEntrySize_ || size > capacity_) return SPCachedResponse();
+    }
+
+    // 在锁外读文件、拼响应
+    std::shared_ptr<CachedResponse> response(new CachedResponse);
+    std::string &data = response->data;
+    data.reserve(header.size() + 32 + size);
+    data += header;
+    data += "Server: LinYa's Web Server\r\n\r\n";
+    response->headerLength = data.size();
+    response->compressible = file->compressible;
+    data.resize(response->headerLength + size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(file->fd, &data[response->headerLength + done], size - done, done);
+        if (n < 0 && errno == EINTR) continue;
+        // 读取期间文件被截断，放弃缓存
+        if (n <= 0) return SPCachedResponse();
+        done += n;
+    }
+
+    MutexLockGuard lock(mutex_);
+    if (changedSinceLocked(key, generation)) return response;
+    std::unordered_map<std::string, size_t>::iterator it = index_.find(key);
+    if (it != index_.end()) return slots_[it->second].response;
+    insertLocked(key, response);
+    return response;
+}
+
+bool ResponseCache::insert(const std::string &key, const SPCachedResponse &response,
+                           uint64_t generation) {
+    if (!FileCache::instance().watching()) return false;
+    MutexLockGuard lock(mutex_);
+    if (changedSinceLocked(key, generation) || index_.count(key)) return false;
+    return insertLocked(key, response);
+}
+
+bool ResponseCache::insertLocked(const std::string &key, const SPCachedResponse &response) {
+    size_t size = response->data.size();
+    evictLocked(size);
+    if (bytes_ + size > capacity_) return false;
+
+    size_t pos;
+    if (!freeSlots_.empty()) {
+        pos = freeSlots_.back();
+        freeSlots_.pop_back();
+    } else {
+        pos = slots_.size();
+        slots_.push_back(Slot());
+    }
+    Slot &slot = slots_[pos];
+    slot.path = key;
+    slot.response = response;
+    // 新条目先不置访问位，只被访问一次的文件会在下一轮被淘汰
+    slot.referenced = false;
+    index_[key] = pos;
+    bytes_ += size;
+    ++stats_.insertions;
+    return true;
+}
+
+void ResponseCache::invalidate(const std::string &path) {
+    MutexLockGuard lock(mutex_);
+    ++generation_;
+    if (path.empty()) {
+        clearedAt_ = generation_;
+        for (size_t i = 0; i < slots_.size(); ++i)
+            if (slots_[i].response) {
+                removeLocked(i);
+                ++stats_.invalidations;
+            }
+        return;
+    }
+    markChangedLocked(path);
+    removeKeyLocked(path);
+    removeKeyLocked(gzipKey(path));
+    // 预压缩的旁路文件(xxx.gz)变化时，xxx的gzip变体也要失效
+    const size_t n = path.size();
+    if (n > 3 && path.compare(n - 3, 3, ".gz") == 0)
+        removeKeyLocked(gzipKey(path.substr(0, n - 3)));
+}
+
+void ResponseCache::markChangedLocked(const std::string &path) {
+    if (changedAt_.size() >= kMaxTrackedChanges) {
+        changedAt_.clear();
+        clearedAt_ = generation_;
+    }
+    changedAt_[path] = generation_;
+}
+
+// gzip变体既依赖原文件，也依赖可能存在的预压缩旁路文件
+bool ResponseCache::changedSinceLocked(const std::string &key, uint64_t generation) const {
+    if (clearedAt_ > generation) return true;
+    const size_t suffixLen = sizeof kGzipSuffix - 1;
+    std::string path = key;
+    bool gzip = key.size() > suffixLen && key.compare(key.size() - suffixLen, suffixLen, kGzipSuffix) == 0;
+    if (gzip) path.resize(key.size() - suffixLen);
+    std::unordered_map<std::string, uint64_t>::const_iterator it = changedAt_.find(path);
+    if (it != changedAt_.end() && it->second > generation) return true;
+    if (gzip) {
+        it = changedAt_.find(path + ".gz");
+        if (it != changedAt_.end() && it->second > generation) return true;
+    }
+    return false;
+}
+
+bool ResponseCache::removeKeyLocked(const std::string &key) {
+    std::unordered_map<std::string, size_t>::iterator it = index_.find(key);
+    if (it == index_.end()) return false;
+    removeLocked(it->second);
+    ++stats_.invalidations;
+    return true;
+}
+
+void ResponseCache::setCapacity(size_t bytes) {
+    MutexLockGuard lock(mutex_);
+    capacity_ = bytes;
+    evictLocked(0);
+}
+
+size_t ResponseCache::capacity() const {
+    MutexLockGuard lock(mutex_);
+    return capacity_;
+}
+
+void ResponseCache::setMaxEntrySize(size_t bytes) {
+    MutexLockGuard lock(mutex_);
+    maxEntrySize_ = bytes;
+}
+
+ResponseCache::Stats ResponseCache::stats() const {
+    MutexLockGuard lock(mutex_);
+    Stats s = stats_;
+    s.entries = index_.size();
+    s.bytes = bytes_;
+    return s;
+}
+
+void ResponseCache::removeLocked(size_t pos) {
+    Slot &slot = slots_[pos];
+    bytes_ -= slot.response->data.size();
+    index_.erase(slot.path);
+    slot.path.clear();
+    slot.response.reset();
+    slot.referenced = false;
+    freeSlots_.push_back(pos);
+}
+
+void ResponseCache::evictLocked(size_t needed) {
+    // 每个条目最多被放过一次，所以最多扫两圈
+    size_t budget = 2 * slots_.size();
+    while (bytes_ + needed > capacity_ && !index_.empty() && budget-- > 0) {
+        if (hand_ >= slots_.size()) hand_ = 0;
+        Slot &slot = slots_[hand_];
+        if (slot.response) {
+            if (slot.referenced) {
+                slot.referenced = false;
+            } else {
+                removeLocked(hand_);
+                ++stats_.evictions;
+            }
+        }
+        ++hand_;
+    }
+}
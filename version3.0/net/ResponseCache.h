@@ -0,0 +1,103 @@
+#pragma once
+#include <pthread.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "FileCache.h"
+#include "../base/MutexLock.h"
+#include "../base/noncopyable.h"
+
+// 序列化好的响应：除状态行和连接相关头部以外的全部头部 + 空行 + 响应体(可能是压缩过的)
+// 状态行和Connection/Keep-Alive头部因请求而异，由HttpData用静态切片补在前面，一次writev发出
+struct CachedResponse : noncopyable {
+    CachedResponse() : headerLength(0), compressible(false) {}
+    std::string data;
+    size_t headerLength; // HEAD请求只发送data的前headerLength个字节
+    bool compressible;   // 未压缩的文本内容，客户端支持gzip时应改用gzip变体
+};
+typedef std::shared_ptr<const CachedResponse> SPCachedResponse;
+
+// 进程级的热点响应缓存，命中时只需要一次查找加一次发送，不需要查文件元信息、拼头部
+// - 容量按字节计，超出时用CLOCK算法淘汰：每个条目有一个访问位，命中时置位，
+//   时钟指针扫过时访问位为1的清零放过，为0的淘汰，近似LRU但命中路径上不需要移动链表节点
+// - 只缓存不超过maxEntrySize的文件，大文件仍然走sendfile
+// - 文件变化由FileCache的inotify通知，对应条目随之失效
+class ResponseCache : noncopyable {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t insertions;
+        uint64_t evictions;
+        uint64_t invalidations;
+        size_t entries;
+        size_t bytes;
+    };
+
+    static ResponseCache &instance();
+
+    // 一次请求的查找，只计一次命中或未命中：acceptGzip时先找gzip变体，没有再找原始响应。
+    // 原始响应是compressible的而客户端支持gzip时，它仍然被返回(后台压缩期间先发它)，但算作未命中
+    SPCachedResponse get(const std::string &path, bool acceptGzip);
+    // 失效计数，未命中时在查FileCache之前取一次，传给fill
+    uint64_t generation() const;
+    // 用FileCache中的文件生成响应并以key放入缓存，header为除状态行外的头部字段(不含空行)；
+    // 取得generation之后该文件发生过变化时仍然返回生成的响应，但不放入缓存。
+    // 文件太大或读取失败时返回空
+    SPCachedResponse fill(const std::string &key, const SPCachedFile &file,
+                          const std::string &header, uint64_t generation);
+    // 放入一个已经生成好的响应(例如后台压缩的结果)，规则同fill
+    bool insert(const std::string &key, const SPCachedResponse &response, uint64_t generation);
+    // 文件变化时该路径的所有变体(原始、gzip)一起失效
+    void invalidate(const std::string &path);
+
+    // 同一文件gzip压缩后的变体在缓存中的key
+    static std::string gzipKey(const std::string &path) { return path + kGzipSuffix; }
+
+    void setCapacity(size_t bytes);
+    size_t capacity() const;
+    void setMaxEntrySize(size_t bytes);
+    Stats stats() const;
+
+    static const size_t kDefaultCapacity = 64 * 1024 * 1024;
+    static const size_t kDefaultMaxEntrySize = 256 * 1024;
+    static const size_t kMaxTrackedChanges = 4096;
+
+private:
+    ResponseCache();
+    static void init();
+
+    struct Slot {
+        std::string path;
+        SPCachedResponse response;
+        bool referenced;
+    };
+    bool insertLocked(const std::string &key, const SPCachedResponse &response);
+    void markChangedLocked(const std::string &path);
+    bool changedSinceLocked(const std::string &key, uint64_t generation) const;
+    bool removeKeyLocked(const std::string &key);
+    void evictLocked(size_t needed);
+    void removeLocked(size_t index);
+
+    // 文件路径中不会出现的字符，保证变体的key不会和真实路径冲突
+    static const char kGzipSuffix[];
+
+    mutable MutexLock mutex_;
+    std::unordered_map<std::string, size_t> index_; // path -> slots_下标
+    std::vector<Slot> slots_;
+    std::vector<size_t> freeSlots_;
+    size_t hand_;
+    size_t bytes_;
+    size_t capacity_;
+    size_t maxEntrySize_;
+    // 失效计数，以及每个路径最近一次失效时的计数，用来发现生成响应期间该文件是否变化过
+    uint64_t generation_;
+    std::unordered_map<std::string, uint64_t> changedAt_;
+    uint64_t clearedAt_;
+    Stats stats_;
+
+    static pthread_once_t once_control_;
+    static ResponseCache *instance_;
+};
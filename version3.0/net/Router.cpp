@@ -0,0 +1,228 @@
+#include "Router.h"
+#include <assert.h>
+#include <string.h>
+#include <map>
+
+const int RouteParams::kMaxParams;
+const int Router::kMethodSlots;
+
+StringPiece RouteParams::get(const StringPiece &name) const {
+    for (int i = 0; i < size_; ++i)
+        if (names_[i] == name) return values_[i];
+    return StringPiece();
+}
+
+struct Router::BuildNode {
+    std::map<char, BuildNodePtr> children;
+    BuildNodePtr param;
+    std::string paramName;
+    int endpoint[kMethodSlots]; // routes_的下标，-1表示没有
+    int wildcard[kMethodSlots];
+
+    BuildNode() {
+        for (int i = 0; i < kMethodSlots; ++i) endpoint[i] = wildcard[i] = -1;
+    }
+    static bool any(const int *routes) {
+        for (int i = 0; i < kMethodSlots; ++i)
+            if (routes[i] >= 0) return true;
+        return false;
+    }
+    // 没有分支也不是终点的节点可以和唯一的子节点合并成一条边
+    bool mergeable() const {
+        return children.size() == 1 && !param && !any(endpoint) && !any(wildcard);
+    }
+};
+
+Router::Router() : root_(new BuildNode), compiled_(false) {}
+
+Router::~Router() {}
+
+namespace {
+
+// ':'和'*'只有紧跟在'/'后面时才有特殊含义
+bool validPattern(const std::string &pattern) {
+    if (pattern.empty() || pattern[0] != '/') return false;
+    int params = 0;
+    for (size_t i = 1; i < pattern.size(); ++i) {
+        if (pattern[i - 1] != '/') continue;
+        if (pattern[i] == '*' && i + 1 != pattern.size()) return false;
+        if (pattern[i] == ':') {
+            size_t end = pattern.find('/', i);
+            if (end == std::string::npos) end = pattern.size();
+            if (end == i + 1 || ++params > RouteParams::kMaxParams) return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool Router::add(int methods, const std::string &pattern, const Handler &handler,
+                 const SinkFactory &sink) {
+    assert(!compiled_);
+    if (compiled_ || !validPattern(pattern)) return false;
+
+    BuildNode *node = root_.get();
+    bool wildcard = false;
+    size_t i = 0;
+    while (i < pattern.size()) {
+        char c = pattern[i];
+        if (i > 0 && pattern[i - 1] == '/' && c == '*') {
+            wildcard = true;
+            break;
+        }
+        if (i > 0 && pattern[i - 1] == '/' && c == ':') {
+            size_t end = pattern.find('/', i);
+            if (end == std::string::npos) end = pattern.size();
+            // 同一位置只有一个参数子节点，名字以第一次注册的为准
+            if (!node->param) {
+                node->param.reset(new BuildNode);
+                node->paramName = pattern.substr(i + 1, end - i - 1);
+            }
+            node = node->param.get();
+            i = end;
+            continue;
+        }
+        BuildNodePtr &child = node->children[c];
+        if (!child) child.reset(new BuildNode);
+        node = child.get();
+        ++i;
+    }
+
+    int index = static_cast<int>(routes_.size());
+    Route route;
+    route.handler = handler;
+    route.sink = sink;
+    routes_.push_back(route);
+    int *slots = wildcard ? node->wildcard : node->endpoint;
+    for (int m = 0; m < kMethodSlots; ++m)
+        if (methods & (1 << m)) slots[m] = index;
+    return true;
+}
+
+void Router::compile() {
+    assert(!compiled_);
+    nodes_.assign(1, Node());
+    flatten(0, *root_, std::string());
+    root_.reset();
+    compiled_ = true;
+}
+
+int32_t Router::addEndpoint(const int *routes) {
+    if (!BuildNode::any(routes)) return -1;
+    Endpoint e;
+    for (int m = 0; m < kMethodSlots; ++m) e.route[m] = static_cast<int16_t>(routes[m]);
+    endpoints_.push_back(e);
+    return static_cast<int32_t>(endpoints_.size() - 1);
+}
+
+// 把node平铺到nodes_[slot]，它的字面量子节点连续地放在新分配的一段里，参数子节点单独放
+void Router::flatten(uint32_t slot, const BuildNode &node, const std::string &label) {
+    Node n;
+    n.label = static_cast<uint32_t>(labels_.size());
+    n.labelLen = static_cast<uint32_t>(label.size());
+    labels_ += label;
+    n.endpoint = addEndpoint(node.endpoint);
+    n.wildcard = addEndpoint(node.wildcard);
+    n.paramChild = -1;
+
+    // 只有一个子节点的链压缩成一条边，查找时一次memcmp比较整段
+    std::vector<std::pair<std::string, const BuildNode *>> edges;
+    for (std::map<char, BuildNodePtr>::const_iterator it = node.children.begin();
+         it != node.children.end(); ++it) {
+        std::string edge(1, it->first);
+        const BuildNode *child = it->second.get();
+        while (child->mergeable()) {
+            edge += child->children.begin()->first;
+            child = child->children.begin()->second.get();
+        }
+        edges.push_back(std::make_pair(edge, child));
+    }
+    n.firstChild = static_cast<uint32_t>(nodes_.size());
+    n.numChildren = static_cast<uint32_t>(edges.size());
+    nodes_.resize(nodes_.size() + edges.size());
+    if (node.param) {
+        n.paramChild = static_cast<int32_t>(nodes_.size());
+        nodes_.push_back(Node());
+    }
+    // nodes_会扩容，先填好这个节点再递归
+    nodes_[slot] = n;
+    for (size_t i = 0; i < edges.size(); ++i)
+        flatten(n.firstChild + static_cast<uint32_t>(i), *edges[i].second, edges[i].first);
+    if (node.param) flatten(n.paramChild, *node.param, node.paramName);
+}
+
+const Router::Route *Router::find(HttpMethod m, const StringPiece &path, RouteParams &params,
+                                  int &allowed) const {
+    params.clear();
+    allowed = 0;
+    if (!compiled_ || path.empty()) return NULL;
+    const Route *found = NULL;
+    match(0, path.begin(), path.end(), m, params, found, allowed);
+    return found;
+}
+
+bool Router::matchEndpoint(int32_t endpoint, int m, const Route *&found, int &allowed) const {
+    if (endpoint < 0) return false;
+    const Endpoint &e = endpoints_[endpoint];
+    if (e.route[m] >= 0) {
+        found = &routes_[e.route[m]];
+        return true;
+    }
+    for (int i = 0; i < kMethodSlots; ++i)
+        if (e.route[i] >= 0) allowed |= 1 << i;
+    return false;
+}
+
+// 依次尝试精确匹配的子节点、参数子节点和前缀，前面的走不通时回退
+bool Router::match(uint32_t index, const char *p, const char *end, int m, RouteParams &params,
+                   const Route *&found, int &allowed) const {
+    const Node &node = nodes_[index];
+    if (p == end && matchEndpoint(node.endpoint, m, found, allowed)) return true;
+    if (p < end) {
+        // 兄弟节点的边首字符各不相同，最多只有一个可能匹配
+        for (uint32_t i = 0; i < node.numChildren; ++i) {
+            const Node &child = nodes_[node.firstChild + i];
+            const char *label = labels_.data() + child.label;
+            if (*label != *p) continue;
+            if (static_cast<size_t>(end - p) >= child.labelLen &&
+                memcmp(label, p, child.labelLen) == 0 &&
+                match(node.firstChild + i, p + child.labelLen, end, m, params, found, allowed))
+                return true;
+            break;
+        }
+        if (node.paramChild >= 0 && *p != '/' && params.size_ < RouteParams::kMaxParams) {
+            const char *segEnd = static_cast<const char *>(memchr(p, '/', end - p));
+            if (segEnd == NULL) segEnd = end;
+            const Node &param = nodes_[node.paramChild];
+            int n = params.size_++;
+            params.names_[n] = StringPiece(labels_.data() + param.label, param.labelLen);
+            params.values_[n] = StringPiece(p, segEnd - p);
+            if (match(node.paramChild, segEnd, end, m, params, found, allowed)) return true;
+            --params.size_;
+        }
+    }
+    if (matchEndpoint(node.wildcard, m, found, allowed)) {
+        params.wildcard_ = StringPiece(p, end - p);
+        return true;
+    }
+    return false;
+}
+
+std::string Router::methodNames(int methods) {
+    static const struct {
+        HttpMethod method;
+        const char *name;
+    } names[] = {{METHOD_GET, "GET"},
+                 {METHOD_HEAD, "HEAD"},
+                 {METHOD_POST, "POST"},
+                 {METHOD_PUT, "PUT"},
+                 {METHOD_DELETE, "DELETE"}};
+    std::string result;
+    for (size_t i = 0; i < sizeof names / sizeof names[0]; ++i) {
+        if (!(methods & method(names[i].method))) continue;
+        if (!result.empty()) result += ", ";
+        result += names[i].name;
+    }
+    return result;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BodySink.h"
+#include "../base/StringPiece.h"
+#include "../base/noncopyable.h"
+
+class HttpData;
+
+enum HttpMethod {
+    METHOD_POST = 1,
+    METHOD_GET,
+    METHOD_HEAD,
+    METHOD_PUT,
+    METHOD_DELETE
+};
+
+// 一次匹配得到的路径参数，直接指向请求路径里的字符，不拷贝；请求处理完之前有效
+class RouteParams {
+public:
+    static const int kMaxParams = 8;
+
+    RouteParams() : size_(0) {}
+    // 按名字取":name"匹配到的那一段，没有时返回空
+    StringPiece get(const StringPiece &name) const;
+    // "*"匹配到的剩余部分
+    StringPiece wildcard() const { return wildcard_; }
+    int size() const { return size_; }
+    void clear() {
+        size_ = 0;
+        wildcard_.clear();
+    }
+
+private:
+    friend class Router;
+    StringPiece names_[kMaxParams];
+    StringPiece values_[kMaxParams];
+    int size_;
+    StringPiece wildcard_;
+};
+
+// 按方法和路径分发请求的路由表
+// 路径模式有三种写法，可以混用：
+// - 精确匹配："/hello"
+// - 参数："/users/:id/posts"，":id"匹配一段不含'/'的非空字符串
+// - 前缀："/static/*"，'*'只能在最后，匹配剩下的全部(可以为空)
+// 同一路径上精确匹配优先于参数，参数优先于前缀；较具体的模式走不通时回退到较宽泛的模式
+// 所有路由在启动时(Server::start)注册完，compile把它们编译成一棵压缩前缀树(radix trie)：
+// 节点、边上的字符串和各方法的路由都平铺在几个数组里，查找时不分配内存，也不比较整条路径
+class Router : noncopyable {
+public:
+    typedef std::function<void(HttpData &, const RouteParams &)> Handler;
+    // 请求带有请求体时由它创建请求体的去处，返回空表示拒绝(403)；
+    // 没有提供时，POST/PUT的请求体放进SpoolBodySink，其它方法的请求体丢弃
+    typedef std::function<SPBodySink(HttpData &, const RouteParams &)> SinkFactory;
+
+    struct Route {
+        Handler handler;
+        SinkFactory sink;
+    };
+
+    static int method(HttpMethod m) { return 1 << m; }
+
+    Router();
+    ~Router();
+    // methods是method()的按位或；同一模式、同一方法后注册的覆盖先注册的
+    // 模式不合法(不以'/'开头、'*'不在最后、参数没有名字或者太多)时返回false
+    bool add(int methods, const std::string &pattern, const Handler &handler,
+             const SinkFactory &sink = SinkFactory());
+    // 注册完之后调用一次，之后只读，各IO线程可以同时查找
+    void compile();
+    bool compiled() const { return compiled_; }
+
+    // 找不到返回NULL，这时allowed是能匹配这条路径的模式所接受的方法(method()的按位或)，
+    // 为0说明路径不存在(404)，否则是方法不允许(405)
+    const Route *find(HttpMethod m, const StringPiece &path, RouteParams &params,
+                      int &allowed) const;
+    // "GET, HEAD"形式的方法列表，用在405的Allow头部
+    static std::string methodNames(int methods);
+
+private:
+    static const int kMethodSlots = 8;
+
+    // 注册阶段用的逐字符前缀树，compile时压缩、平铺成下面的数组
+    struct BuildNode;
+    typedef std::unique_ptr<BuildNode> BuildNodePtr;
+
+    // 平铺后的节点：到达一个节点时已经消耗了它的边(label)，字面量子节点连续存放、按边的首字符排序
+    struct Node {
+        uint32_t label;
+        uint32_t labelLen;
+        uint32_t firstChild;
+        uint32_t numChildren;
+        int32_t paramChild;  // ":name"子节点，-1表示没有；参数子节点的label是参数名
+        int32_t endpoint;    // 路径在这里结束时的各方法路由，endpoints_的下标
+        int32_t wildcard;    // 这里之后是"*"时的各方法路由
+    };
+    struct Endpoint {
+        int16_t route[kMethodSlots]; // routes_的下标，-1表示这个方法没有路由
+    };
+
+    int32_t addEndpoint(const int *routes);
+    void flatten(uint32_t slot, const BuildNode &node, const std::string &label);
+    bool match(uint32_t node, const char *p, const char *end, int m, RouteParams &params,
+               const Route *&found, int &allowed) const;
+    bool matchEndpoint(int32_t endpoint, int m, const Route *&found, int &allowed) const;
+
+    BuildNodePtr root_;
+    std::vector<Route> routes_;
+    std::vector<Node> nodes_;
+    std::vector<Endpoint> endpoints_;
+    std::string labels_;
+    bool compiled_;
+};
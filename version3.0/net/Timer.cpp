@@ -1,80 +1,188 @@
+// @Author Lin Ya
+// @Email xxbbb@vip.qq.com
 #include "Timer.h"
-#include <sys/time.h>
-#include <unistd.h>
-#include <queue>
+#include <string.h>
+#include "../base/CachedClock.h"
 
-TimerNode::TimerNode(std::shared_ptr<HttpData> requestData, int timeout)
-    : deleted_(false), SPHttpData(requestData) {
-  struct timeval now;
-  gettimeofday(&now, NULL);
-  // 以毫秒计
-  expiredTime_ =
-      (((now.tv_sec % 10000) * 1000) + (now.tv_usec / 1000)) + timeout;
+TimerManager::TimerManager()
+    : current_(CachedClock::nowMs()),
+      runningTimer_(NULL),
+      runningCancelled_(false),
+      finishedTimer_(NULL) {
+  memset(rootBits_, 0, sizeof rootBits_);
+  memset(levelBits_, 0, sizeof levelBits_);
+  // 每个槽的哨兵头自己连成环
+  for (int i = 0; i < kRootSize; ++i) root_[i].prev_ = root_[i].next_ = &root_[i];
+  for (int l = 0; l < kLevels; ++l)
+    for (int i = 0; i < kLevelSize; ++i)
+      levels_[l][i].prev_ = levels_[l][i].next_ = &levels_[l][i];
 }
 
-TimerNode::~TimerNode() {
-  if (SPHttpData) SPHttpData->handleClose();
+TimerManager::~TimerManager() {
+  for (std::unordered_map<int64_t, Timer *>::iterator it = timers_.begin(); it != timers_.end(); ++it)
+    delete it->second;
+  // 还挂着的节点属于别的对象，只把它们摘下来
+  for (int i = 0; i < kRootSize; ++i)
+    while (root_[i].next_ != &root_[i]) root_[i].next_->unlink();
+  for (int l = 0; l < kLevels; ++l)
+    for (int i = 0; i < kLevelSize; ++i)
+      while (levels_[l][i].next_ != &levels_[l][i]) levels_[l][i].next_->unlink();
 }
 
-TimerNode::TimerNode(TimerNode &tn)
-    : SPHttpData(tn.SPHttpData), expiredTime_(0) {}
+void TimerManager::linkBefore(TimerNode *head, TimerNode *node) {
+  node->prev_ = head->prev_;
+  node->next_ = head;
+  head->prev_->next_ = node;
+  head->prev_ = node;
+}
+
+void TimerManager::addTimer(TimerNode *node, int timeout) {
+  // 以毫秒计，用所在loop本轮缓存的单调时钟
+  addTimerAt(node, CachedClock::nowMs() + timeout);
+}
+
+void TimerManager::addTimerAt(TimerNode *node, int64_t expiredTime) {
+  node->unlink();
+  node->expiredTime_ = expiredTime;
+  place(node);
+}
 
-void TimerNode::update(int timeout) {
-  struct timeval now;
-  gettimeofday(&now, NULL);
-  expiredTime_ =
-      (((now.tv_sec % 10000) * 1000) + (now.tv_usec / 1000)) + timeout;
+void TimerManager::schedule(int64_t when, int interval, int64_t sequence, TimerNode::Callback cb) {
+  Timer *timer = new Timer;
+  timer->callback = std::move(cb);
+  timer->interval = interval;
+  timer->sequence = sequence;
+  timer->node.setCallback([this, timer]() { runTimer(timer); });
+  timers_[sequence] = timer;
+  addTimerAt(&timer->node, when);
 }
 
-bool TimerNode::isValid() {
-  struct timeval now;
-  gettimeofday(&now, NULL);
-  size_t temp = (((now.tv_sec % 10000) * 1000) + (now.tv_usec / 1000));
-  if (temp < expiredTime_)
-    return true;
-  else {
-    this->setDeleted();
-    return false;
+void TimerManager::cancel(int64_t sequence) {
+  std::unordered_map<int64_t, Timer *>::iterator it = timers_.find(sequence);
+  if (it == timers_.end()) return;
+  // 在自己的回调里取消自己：回调返回后再删
+  if (it->second == runningTimer_) {
+    runningCancelled_ = true;
+    return;
   }
+  delete it->second;
+  timers_.erase(it);
 }
 
-void TimerNode::clearReq() {
-  SPHttpData.reset();
-  this->setDeleted();
+void TimerManager::runTimer(Timer *timer) {
+  runningTimer_ = timer;
+  runningCancelled_ = false;
+  timer->callback();
+  runningTimer_ = NULL;
+  if (timer->interval > 0 && !runningCancelled_) {
+    // 按计划的时间往后排，不随回调执行的早晚漂移；落后太多时不补执行
+    int64_t next = timer->node.expiredTime_ + timer->interval;
+    if (next < current_) next = current_;
+    addTimerAt(&timer->node, next);
+  } else {
+    timers_.erase(timer->sequence);
+    finishedTimer_ = timer;
+  }
 }
 
-TimerManager::TimerManager() {}
+void TimerManager::place(TimerNode *node) {
+  int64_t expires = node->expiredTime_;
+  int64_t delta = expires - current_;
+  TimerNode *head;
+  if (delta < kRootSize) {
+    // 已经过期的挂在马上要处理的槽上
+    int index = (delta < 0 ? current_ : expires) & (kRootSize - 1);
+    head = &root_[index];
+    rootBits_[index >> 6] |= (uint64_t)1 << (index & 63);
+  } else {
+    if (delta >= kMaxSpan) {
+      // 超出时间轮能表示的范围，先挂在最远的位置，到时再按剩余时间重新分
+      expires = current_ + kMaxSpan - 1;
+      delta = kMaxSpan - 1;
+    }
+    int level = 0;
+    while (delta >= ((int64_t)1 << (kRootBits + (level + 1) * kLevelBits))) ++level;
+    int index = (expires >> (kRootBits + level * kLevelBits)) & (kLevelSize - 1);
+    head = &levels_[level][index];
+    levelBits_[level] |= (uint64_t)1 << index;
+  }
+  linkBefore(head, node);
+}
 
-TimerManager::~TimerManager() {}
+int TimerManager::cascade(int level, int index) {
+  TimerNode *head = &levels_[level][index];
+  // 先把整条链表从槽上取下来，再逐个按剩余时间放到下面几层
+  TimerNode *node = head->next_;
+  head->prev_ = head->next_ = head;
+  while (node != head) {
+    TimerNode *next = node->next_;
+    node->prev_ = node->next_ = NULL;
+    place(node);
+    node = next;
+  }
+  return index;
+}
 
-void TimerManager::addTimer(std::shared_ptr<HttpData> SPHttpData, int timeout) {
-  SPTimerNode new_node(new TimerNode(SPHttpData, timeout));
-  timerNodeQueue.push(new_node);
-  SPHttpData->linkTimer(new_node);
+void TimerManager::handleExpiredEvent() { expireUntil(CachedClock::nowMs()); }
+
+void TimerManager::expireUntil(int64_t now) {
+  while (current_ <= now) {
+    int index = current_ & (kRootSize - 1);
+    // 第0层转完一圈，从上一层取下一批，依此类推
+    if (index == 0) {
+      for (int l = 0; l < kLevels; ++l) {
+        int i = (current_ >> (kRootBits + l * kLevelBits)) & (kLevelSize - 1);
+        if (cascade(l, i) != 0) break;
+      }
+    }
+    TimerNode *head = &root_[index];
+    ++current_;
+    // 回调里可能刷新或取消别的定时器，每次都从头取
+    while (head->next_ != head) {
+      TimerNode *node = head->next_;
+      node->unlink();
+      if (node->callback_) node->callback_();
+      if (finishedTimer_) {
+        delete finishedTimer_;
+        finishedTimer_ = NULL;
+      }
+    }
+  }
 }
 
-/* 处理逻辑是这样的~
-因为(1) 优先队列不支持随机访问
-(2) 即使支持，随机删除某节点后破坏了堆的结构，需要重新更新堆结构。
-所以对于被置为deleted的时间节点，会延迟到它(1)超时 或
-(2)它前面的节点都被删除时，它才会被删除。
-一个点被置为deleted,它最迟会在TIMER_TIME_OUT时间后被删除。
-这样做有两个好处：
-(1) 第一个好处是不需要遍历优先队列，省时。
-(2)
-第二个好处是给超时时间一个容忍的时间，就是设定的超时时间是删除的下限(并不是一到超时时间就立即删除)，如果监听的请求在超时后的下一次请求中又一次出现了，
-就不用再重新申请RequestData节点了，这样可以继续重复利用前面的RequestData，减少了一次delete和一次new的时间。
-*/
+int TimerManager::findSlot(TimerNode *slots, uint64_t *bits, int size, int start) {
+  // 最多绕一圈，多看一个字是为了回到start所在的字里start前面的位
+  int words = size / 64;
+  for (int n = 0; n <= words; ++n) {
+    int w = ((start >> 6) + n) % words;
+    uint64_t mask = bits[w];
+    if (n == 0) mask &= ~(uint64_t)0 << (start & 63);
+    while (mask) {
+      int index = w * 64 + __builtin_ctzll(mask);
+      if (slots[index].next_ != &slots[index]) return index;
+      // 槽里的节点都已经自己摘下了
+      bits[w] &= ~((uint64_t)1 << (index & 63));
+      mask &= mask - 1;
+    }
+  }
+  return -1;
+}
 
-void TimerManager::handleExpiredEvent() {
-  // MutexLockGuard locker(lock);
-  while (!timerNodeQueue.empty()) {
-    SPTimerNode ptimer_now = timerNodeQueue.top();
-    if (ptimer_now->isDeleted())
-      timerNodeQueue.pop();
-    else if (ptimer_now->isValid() == false)
-      timerNodeQueue.pop();
-    else
-      break;
+int64_t TimerManager::nextExpiration() {
+  // 第0层的槽里都是256ms以内到期的，找到就是准确的到期时间
+  int start = current_ & (kRootSize - 1);
+  int index = findSlot(root_, rootBits_, kRootSize, start);
+  if (index >= 0) return current_ + ((index - start) & (kRootSize - 1));
+  // 第0层是空的，那么最早也要等到上面某一层有定时器的槽被分下来
+  int64_t next = -1;
+  for (int l = 0; l < kLevels; ++l) {
+    int shift = kRootBits + l * kLevelBits;
+    // current_正好在这一层的槽边界上时，当前槽还没分下来；否则当前槽已经分过了，从下一个槽开始找
+    int64_t slot = (current_ + ((int64_t)1 << shift) - 1) >> shift;
+    int found = findSlot(levels_[l], &levelBits_[l], kLevelSize, slot & (kLevelSize - 1));
+    if (found < 0) continue;
+    int64_t when = (slot + ((found - slot) & (kLevelSize - 1))) << shift;
+    if (next < 0 || when < next) next = when;
   }
-}
\ No newline at end of file
+  return next;
+}
@@ -1,51 +1,109 @@
 // @Author Lin Ya
 // @Email xxbbb@vip.qq.com
 #pragma once
-#include <unistd.h>
-#include <deque>
-#include <memory>
-#include <queue>
-#include "HttpData.h"
-#include "../base/MutexLock.h"
+#include <stdint.h>
+#include <functional>
+#include <unordered_map>
 #include "../base/noncopyable.h"
 
-class HttpData;
-
-class TimerNode {
+// 定时器节点：侵入式双向链表节点，嵌在使用它的对象里(比如每个HttpData一个)，
+// 不单独分配；挂在时间轮的某个槽上，刷新和取消都是O(1)地摘下再挂上
+class TimerNode : noncopyable {
  public:
-  TimerNode(std::shared_ptr<HttpData> requestData, int timeout);
-  ~TimerNode();
-  TimerNode(TimerNode &tn);
-  void update(int timeout);
-  bool isValid();
-  void clearReq();
-  void setDeleted() { deleted_ = true; }
-  bool isDeleted() const { return deleted_; }
-  size_t getExpTime() const { return expiredTime_; }
+  typedef std::function<void()> Callback;
+  TimerNode() : prev_(NULL), next_(NULL), expiredTime_(0) {}
+  explicit TimerNode(Callback cb)
+      : prev_(NULL), next_(NULL), expiredTime_(0), callback_(std::move(cb)) {}
+  ~TimerNode() { unlink(); }
+  void setCallback(Callback cb) { callback_ = std::move(cb); }
+  // 是否挂在时间轮上(还没到期，也没有取消)
+  bool isLinked() const { return next_ != NULL; }
+  // 从时间轮上摘下，没挂着时什么也不做
+  void unlink() {
+    if (next_ == NULL) return;
+    prev_->next_ = next_;
+    next_->prev_ = prev_;
+    prev_ = next_ = NULL;
+  }
+  int64_t getExpTime() const { return expiredTime_; }
 
  private:
-  bool deleted_;
-  size_t expiredTime_;
-  std::shared_ptr<HttpData> SPHttpData;
+  friend class TimerManager;
+  TimerNode *prev_;
+  TimerNode *next_;
+  int64_t expiredTime_;  // 到期时间，毫秒
+  Callback callback_;
 };
 
-struct TimerCmp {
-  bool operator()(std::shared_ptr<TimerNode> &a,
-                  std::shared_ptr<TimerNode> &b) const {
-    return a->getExpTime() > b->getExpTime();
-  }
+// EventLoop::runAt/runAfter/runEvery返回的句柄，交给同一个loop的cancel取消；
+// 可以复制，定时器已经执行完或者取消过时cancel什么也不做
+class TimerId {
+ public:
+  TimerId() : sequence_(0) {}
+  explicit TimerId(int64_t sequence) : sequence_(sequence) {}
+  int64_t sequence() const { return sequence_; }
+
+ private:
+  int64_t sequence_;
 };
 
-class TimerManager {
+// 分层时间轮，精度1毫秒：第0层256个槽，每槽1ms；上面三层各64个槽，每槽是下一层转一圈的时间，
+// 一共能表示2^26ms(约18小时)以内的超时，更远的按最远的算。
+// 添加、刷新、取消都是O(1)；时间走到上一层的某个槽时，把槽里的定时器按剩余时间重新分到下面几层。
+// 时间由所在loop每轮缓存的单调时钟推进，只在loop的线程里使用
+class TimerManager : noncopyable {
  public:
   TimerManager();
   ~TimerManager();
-  void addTimer(std::shared_ptr<HttpData> SPHttpData, int timeout);
+  // 添加或刷新：node已经挂着时先摘下，timeout毫秒后到期
+  void addTimer(TimerNode *node, int timeout);
+  // 按绝对时间(与CachedClock::nowMs()同一时钟)添加或刷新
+  void addTimerAt(TimerNode *node, int64_t expiredTime);
+  void cancel(TimerNode *node) { node->unlink(); }
+  // 通用定时器：when(毫秒，CachedClock::nowMs()的时钟)到期时执行cb，interval大于0时之后每隔interval毫秒执行一次；
+  // 节点由TimerManager分配，用sequence找回来取消。EventLoop::runAt等在loop的线程里调用这两个
+  void schedule(int64_t when, int interval, int64_t sequence, TimerNode::Callback cb);
+  void cancel(int64_t sequence);
+  // 执行到当前时间为止到期的定时器
   void handleExpiredEvent();
+  // 时间推进到now，执行到期的定时器(handleExpiredEvent用的是本轮缓存的时钟)
+  void expireUntil(int64_t now);
+  // 最早可能有定时器到期的时间，没有定时器时返回-1；
+  // 还挂在上层的定时器按它们被分下来的时间算，不会晚于真正的到期时间
+  int64_t nextExpiration();
 
  private:
-  typedef std::shared_ptr<TimerNode> SPTimerNode;
-  std::priority_queue<SPTimerNode, std::deque<SPTimerNode>, TimerCmp>
-      timerNodeQueue;
-  // MutexLock lock;
-};
\ No newline at end of file
+  static const int kRootBits = 8;
+  static const int kLevelBits = 6;
+  static const int kLevels = 3;  // 第0层以外的层数
+  static const int kRootSize = 1 << kRootBits;
+  static const int kLevelSize = 1 << kLevelBits;
+  static const int64_t kMaxSpan = (int64_t)1 << (kRootBits + kLevels * kLevelBits);
+
+  struct Timer {
+    TimerNode node;
+    TimerNode::Callback callback;
+    int interval;
+    int64_t sequence;
+  };
+  void runTimer(Timer *timer);
+
+  void place(TimerNode *node);
+  // 把上层第level层index号槽里的定时器重新分下去，返回index
+  int cascade(int level, int index);
+  static void linkBefore(TimerNode *head, TimerNode *node);
+  // 从start号槽开始(循环)找第一个非空的槽，找不到返回-1
+  static int findSlot(TimerNode *slots, uint64_t *bits, int size, int start);
+
+  int64_t current_;  // 下一个要处理的毫秒
+  TimerNode root_[kRootSize];
+  TimerNode levels_[kLevels][kLevelSize];
+  // 哪些槽上可能挂着定时器：挂上时置位，节点自己摘下时不知道在哪个槽，查找时发现槽空了再清掉
+  uint64_t rootBits_[kRootSize / 64];
+  uint64_t levelBits_[kLevels];
+  // 还没结束的通用定时器
+  std::unordered_map<int64_t, Timer *> timers_;
+  Timer *runningTimer_;       // 正在执行回调的通用定时器
+  bool runningCancelled_;     // 它在自己的回调里被取消了
+  Timer *finishedTimer_;      // 执行完的一次性定时器，回调返回后再删(节点的回调就是它自己的)
+};
@@ -8,11 +8,12 @@
 #include <netinet/tcp.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/sendfile.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 
-const int MAX_BUFF = 4096;
 ssize_t readn(int fd, void *buff, size_t n) {
   size_t nleft = n;
   ssize_t nread = 0;
@@ -36,59 +37,28 @@ ssize_t readn(int fd, void *buff, size_t n) {
   return readSum;
 }
 
-ssize_t readn(int fd, std::string &inBuffer, bool &zero) {
+// 边沿触发模式下要一直读到EAGAIN，数据直接readv进Buffer，不再经过临时string
+// 读满limit时提前返回，调用者处理完这一批再接着读
+ssize_t readn(int fd, Buffer &inBuffer, bool &zero, size_t limit) {
   ssize_t nread = 0;
   ssize_t readSum = 0;
+  int savedErrno = 0;
   while (true) {
-    char buff[MAX_BUFF];
-    if ((nread = read(fd, buff, MAX_BUFF)) < 0) {
-      if (errno == EINTR)
+    if ((nread = inBuffer.readFd(fd, &savedErrno)) < 0) {
+      if (savedErrno == EINTR)
         continue;
-      else if (errno == EAGAIN) {
+      else if (savedErrno == EAGAIN) {
         return readSum;
       } else {
         perror("read error");
         return -1;
       }
     } else if (nread == 0) {
-      // printf("redsum = %d\n", readSum);
       zero = true;
       break;
     }
-    // printf("before inBuffer.size() = %d\n", inBuffer.size());
-    // printf("nread = %d\n", nread);
-    readSum += nread;
-    // buff += nread;
-    inBuffer += std::string(buff, buff + nread);
-    // printf("after inBuffer.size() = %d\n", inBuffer.size());
-  }
-  return readSum;
-}
-
-ssize_t readn(int fd, std::string &inBuffer) {
-  ssize_t nread = 0;
-  ssize_t readSum = 0;
-  while (true) {
-    char buff[MAX_BUFF];
-    if ((nread = read(fd, buff, MAX_BUFF)) < 0) {
-      if (errno == EINTR)
-        continue;
-      else if (errno == EAGAIN) {
-        return readSum;
-      } else {
-        perror("read error");
-        return -1;
-      }
-    } else if (nread == 0) {
-      // printf("redsum = %d\n", readSum);
-      break;
-    }
-    // printf("before inBuffer.size() = %d\n", inBuffer.size());
-    // printf("nread = %d\n", nread);
     readSum += nread;
-    // buff += nread;
-    inBuffer += std::string(buff, buff + nread);
-    // printf("after inBuffer.size() = %d\n", inBuffer.size());
+    if (static_cast<size_t>(readSum) >= limit) break;
   }
   return readSum;
 }
@@ -117,34 +87,52 @@ ssize_t writen(int fd, void *buff, size_t n) {
   return writeSum;
 }
 
-ssize_t writen(int fd, std::string &sbuff) {
-  size_t nleft = sbuff.size();
+// 已写出的数据通过retrieve丢弃，只移动下标，不拷贝剩余数据
+ssize_t writen(int fd, Buffer &outBuffer) {
   ssize_t nwritten = 0;
   ssize_t writeSum = 0;
-  const char *ptr = sbuff.c_str();
-  while (nleft > 0) {
-    if ((nwritten = write(fd, ptr, nleft)) <= 0) {
+  while (outBuffer.readableBytes() > 0) {
+    if ((nwritten = write(fd, outBuffer.peek(), outBuffer.readableBytes())) <= 0) {
       if (nwritten < 0) {
         if (errno == EINTR) {
-          nwritten = 0;
           continue;
         } else if (errno == EAGAIN)
           break;
         else
           return -1;
       }
+      continue;
     }
     writeSum += nwritten;
-    nleft -= nwritten;
-    ptr += nwritten;
+    outBuffer.retrieve(nwritten);
   }
-  if (writeSum == static_cast<int>(sbuff.size()))
-    sbuff.clear();
-  else
-    sbuff = sbuff.substr(writeSum);
   return writeSum;
 }
 
+// 从inFd的offset处向outFd发送remain个字节，数据不经过用户态
+// 返回本次发送的字节数，并同步推进offset和remain；遇到EAGAIN时提前返回
+ssize_t sendfilen(int outFd, int inFd, off_t &offset, size_t &remain) {
+  ssize_t nsent = 0;
+  ssize_t sendSum = 0;
+  while (remain > 0) {
+    if ((nsent = sendfile(outFd, inFd, &offset, remain)) <= 0) {
+      if (nsent < 0) {
+        if (errno == EINTR)
+          continue;
+        else if (errno == EAGAIN)
+          break;
+        else
+          return -1;
+      }
+      // 文件在发送过程中被截断
+      return -1;
+    }
+    sendSum += nsent;
+    remain -= nsent;
+  }
+  return sendSum;
+}
+
 void handle_for_sigpipe() {
   struct sigaction sa;
   memset(&sa, '\0', sizeof(sa));
@@ -220,4 +208,46 @@ int socket_bind_listen(int port) {
     return -1;
   }
   return listen_fd;
+}
+int getOpenFileLimit() {
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) < 0 || rl.rlim_cur == RLIM_INFINITY) return 1024;
+  return static_cast<int>(rl.rlim_cur);
+}
+
+int raiseOpenFileLimit(int n) {
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) < 0) return getOpenFileLimit();
+  rlim_t want = static_cast<rlim_t>(n);
+  if (rl.rlim_cur >= want) return getOpenFileLimit();
+  rl.rlim_cur = want;
+  if (rl.rlim_max != RLIM_INFINITY && rl.rlim_max < want) rl.rlim_max = want;
+  if (setrlimit(RLIMIT_NOFILE, &rl) < 0) {
+    // 没有权限提高硬限制时，至少把软限制提到硬限制
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  return getOpenFileLimit();
+}
+
+std::string httpDate(time_t t) {
+  char buf[32];
+  struct tm tm_time;
+  gmtime_r(&t, &tm_time);
+  strftime(buf, sizeof buf, "%a, %d %b %Y %H:%M:%S GMT", &tm_time);
+  return buf;
+}
+
+bool parseHttpDate(const char *str, size_t len, time_t &t) {
+  char buf[64];
+  if (len >= sizeof buf) return false;
+  memcpy(buf, str, len);
+  buf[len] = '\0';
+  struct tm tm_time;
+  memset(&tm_time, 0, sizeof tm_time);
+  const char *end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm_time);
+  if (end == NULL || *end != '\0') return false;
+  t = timegm(&tm_time);
+  return true;
 }
\ No newline at end of file
@@ -1,17 +1,29 @@
 // @Author Lin Ya
 // @Email xxbbb@vip.qq.com
 #pragma once
+#include <sys/types.h>
+#include <stdint.h>
+#include <time.h>
 #include <cstdlib>
 #include <string>
+#include "Buffer.h"
 
 ssize_t readn(int fd, void *buff, size_t n);
-ssize_t readn(int fd, std::string &inBuffer, bool &zero);
-ssize_t readn(int fd, std::string &inBuffer);
+ssize_t readn(int fd, Buffer &inBuffer, bool &zero, size_t limit = SIZE_MAX);
 ssize_t writen(int fd, void *buff, size_t n);
-ssize_t writen(int fd, std::string &sbuff);
+ssize_t writen(int fd, Buffer &outBuffer);
+ssize_t sendfilen(int outFd, int inFd, off_t &offset, size_t &remain);
 void handle_for_sigpipe();
 int setSocketNonBlocking(int fd);
 void setSocketNodelay(int fd);
 void setSocketNoLinger(int fd);
 void shutDownWR(int fd);
-int socket_bind_listen(int port);
\ No newline at end of file
+int socket_bind_listen(int port);
+// 进程能打开的文件描述符数(RLIMIT_NOFILE的软限制)
+int getOpenFileLimit();
+// 把RLIMIT_NOFILE调到n，超过硬限制时需要root权限，返回调整后的软限制
+int raiseOpenFileLimit(int n);
+// RFC 7231 HTTP-date，例如 "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string httpDate(time_t t);
+// 解析HTTP-date，格式不对返回false
+bool parseHttpDate(const char *str, size_t len, time_t &t);
\ No newline at end of file
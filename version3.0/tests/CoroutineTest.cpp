@@ -0,0 +1,129 @@
+// 协程的检查：fd出错或者被对端重置时，等在上面的协程也必须恢复，
+// 否则协程帧和它注册的Channel就一直留在loop里；协程抛出的异常不能让进程退出。
+// 用法: ./CoroutineTest，全部通过时返回0
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdexcept>
+#include "../net/EventLoop.h"
+
+namespace {
+
+// 每个检查最多等这么久，协程没有恢复就算失败
+const int kTimeoutMs = 2000;
+
+int listenLoopback(struct sockaddr_in &addr) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof addr;
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof addr) < 0 || listen(fd, 4) < 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &len) < 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 非阻塞地连到addr，连接还在进行或者已经建立时返回fd
+int connectNonBlocking(const struct sockaddr_in &addr) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const struct sockaddr *)&addr, sizeof addr) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 在loop里运行task，结束后退出loop；超时也退出，返回task是否结束了，ok为task是否正常结束
+bool runInLoop(EventLoop &loop, Task<> task, bool *ok = NULL) {
+    bool done = false;
+    spawn(std::move(task), [&loop, &done, ok](bool succeeded) {
+        done = true;
+        if (ok) *ok = succeeded;
+        loop.quit();
+    });
+    TimerId timeout = loop.runAfter(kTimeoutMs, [&loop]() { loop.quit(); });
+    if (!done) loop.loop();
+    loop.cancel(timeout);
+    return done;
+}
+
+Task<> waitWritable(EventLoop &loop, int fd, int beforeMs, int &revents) {
+    if (beforeMs > 0) co_await loop.sleep(beforeMs);
+    revents = co_await loop.writable(fd);
+}
+
+// 连接被拒绝：等可写的协程收到ERR|HUP|OUT，没有EPOLLIN
+bool checkConnectRefused(EventLoop &loop) {
+    struct sockaddr_in addr;
+    int listenFd = listenLoopback(addr);
+    if (listenFd < 0) return false;
+    // 关掉监听socket，端口上就没有人了
+    close(listenFd);
+    int fd = connectNonBlocking(addr);
+    if (fd < 0) return errno == ECONNREFUSED;
+    int revents = 0;
+    bool done = runInLoop(loop, waitWritable(loop, fd, 0, revents));
+    close(fd);
+    if (!done) printf("connect refused: coroutine was not resumed\n");
+    return done && (revents & (EPOLLERR | EPOLLHUP));
+}
+
+// 对端用RST关闭(SO_LINGER为0)之后再等可写
+bool checkPeerReset(EventLoop &loop) {
+    struct sockaddr_in addr;
+    int listenFd = listenLoopback(addr);
+    if (listenFd < 0) return false;
+    int fd = connectNonBlocking(addr);
+    int peer = fd < 0 ? -1 : accept(listenFd, NULL, NULL);
+    close(listenFd);
+    if (peer < 0) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    struct linger lg = {1, 0};
+    setsockopt(peer, SOL_SOCKET, SO_LINGER, &lg, sizeof lg);
+    close(peer);
+    int revents = 0;
+    // 先等一下，保证RST已经到了
+    bool done = runInLoop(loop, waitWritable(loop, fd, 50, revents));
+    close(fd);
+    if (!done) printf("peer reset: coroutine was not resumed\n");
+    return done && (revents & (EPOLLERR | EPOLLHUP));
+}
+
+Task<> throwAfterSleep(EventLoop &loop) {
+    co_await loop.sleep(1);
+    throw std::runtime_error("handler failed");
+}
+
+// 挂起之后抛出的异常：spawn截住它，onDone照样被调用，ok为false
+bool checkException(EventLoop &loop) {
+    bool ok = true;
+    bool done = runInLoop(loop, throwAfterSleep(loop), &ok);
+    return done && !ok;
+}
+
+}  // namespace
+
+int main() {
+    EventLoop loop;
+    bool ok = true;
+    bool refused = checkConnectRefused(loop);
+    printf("check connect refused: %s\n", refused ? "ok" : "FAILED");
+    ok = ok && refused;
+    bool reset = checkPeerReset(loop);
+    printf("check peer reset: %s\n", reset ? "ok" : "FAILED");
+    ok = ok && reset;
+    bool exception = checkException(loop);
+    printf("check exception: %s\n", exception ? "ok" : "FAILED");
+    ok = ok && exception;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+// HttpScanner各实现(scalar/SSE4.2/AVX2)的结果必须一致：某个SIMD实现的区间常量或者掩码写错时，
+// 只有在那种CPU上解析才会出错，这里把当前CPU支持的实现都和逐字节查表的结果比一遍。
+// 用法: ./HttpScannerTest，全部一致时返回0
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "../net/HttpScanner.h"
+
+namespace {
+
+int failures = 0;
+
+// 在[begin, end)上比较各实现和scalar的结果
+void compare(const HttpScanner *scanners, int n, const char *begin, const char *end, const char *what) {
+    const char *wantCtl = scanners[0].controlChar(begin, end);
+    const char *wantName = scanners[0].headerNameEnd(begin, end);
+    for (int i = 1; i < n; ++i) {
+        const char *ctl = scanners[i].controlChar(begin, end);
+        const char *name = scanners[i].headerNameEnd(begin, end);
+        if (ctl != wantCtl || name != wantName) {
+            if (++failures <= 10)
+                printf("%s: %s, len %d: controlChar %d (scalar %d), headerNameEnd %d (scalar %d)\n",
+                       scanners[i].name, what, static_cast<int>(end - begin), static_cast<int>(ctl - begin),
+                       static_cast<int>(wantCtl - begin), static_cast<int>(name - begin),
+                       static_cast<int>(wantName - begin));
+        }
+    }
+}
+
+// 不会被任何一个函数停下的填充字节，包括0x80以上的字节(检查无符号比较)
+char filler(int i) {
+    static const char kFill[] = "abcXYZ09-_~!\x80\xa0\xff\xfe";
+    return kFill[i % (sizeof kFill - 1)];
+}
+
+}  // namespace
+
+int main() {
+    HttpScanner scanners[8];
+    int n = availableHttpScanners(scanners, 8);
+    printf("scanners:");
+    for (int i = 0; i < n; ++i) printf(" %s", scanners[i].name);
+    printf(" (in use: %s)\n", httpScannerName());
+
+    // 每个长度单独分配，结尾正好是缓冲区的末尾，读过界时在ASan下能发现
+    const int kMaxLen = 70;  // 覆盖短于一个向量、正好16/32字节和跨两个32字节块的情况
+    for (int len = 0; len <= kMaxLen; ++len) {
+        for (int align = 0; align < 2; ++align) {
+            std::vector<char> storage(len + align);
+            char *buf = storage.data() + align;
+            for (int i = 0; i < len; ++i) buf[i] = filler(i);
+            compare(scanners, n, buf, buf + len, "no delimiter");
+            // 每个字节值放在每个位置上：控制字符、'\t'、空格、':'、0x7f和其它字节都在其中
+            for (int pos = 0; pos < len; ++pos) {
+                for (int c = 0; c < 256; ++c) {
+                    buf[pos] = static_cast<char>(c);
+                    compare(scanners, n, buf, buf + len, "one byte");
+                }
+                buf[pos] = filler(pos);
+            }
+        }
+    }
+
+    // 多个分隔符时要停在第一个上：'\t'(不是控制字符但是名字的结束)在前，后面跟着别的
+    const char kPairs[][2] = {{'\t', '\r'}, {' ', ':'}, {':', '\x7f'}, {'\x7f', '\n'}, {'\x80', '\x1f'}};
+    for (size_t k = 0; k < sizeof kPairs / sizeof kPairs[0]; ++k) {
+        for (int first = 0; first < 48; ++first) {
+            for (int second = first + 1; second < 64; ++second) {
+                std::vector<char> storage(64);
+                char *buf = storage.data();
+                for (int i = 0; i < 64; ++i) buf[i] = filler(i);
+                buf[first] = kPairs[k][0];
+                buf[second] = kPairs[k][1];
+                compare(scanners, n, buf, buf + 64, "two bytes");
+            }
+        }
+    }
+
+    // 随机内容，偏向可打印字符
+    srand(1);
+    std::vector<char> random(4096);
+    for (int round = 0; round < 2000; ++round) {
+        for (size_t i = 0; i < random.size(); ++i) {
+            int r = rand();
+            random[i] = r % 64 == 0 ? static_cast<char>(r >> 8) : static_cast<char>('!' + (r >> 8) % 94);
+        }
+        size_t begin = rand() % 64;
+        size_t end = begin + rand() % (random.size() - begin);
+        compare(scanners, n, random.data() + begin, random.data() + end, "random");
+    }
+
+    if (failures) {
+        printf("FAILED: %d mismatches\n", failures);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
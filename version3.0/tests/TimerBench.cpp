@@ -0,0 +1,230 @@
+// 时间轮(TimerManager)和原来的优先队列+延迟删除做法的对比：
+// 100万个连接定时器，插入、反复刷新(每个连接收到新请求)、全部到期，分别计时。
+// 用法: ./TimerBench [定时器个数] [刷新轮数]，正确性检查全部通过时返回0
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <vector>
+#include "../base/CachedClock.h"
+#include "../net/Timer.h"
+
+namespace {
+
+double nowSeconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// 代替HttpData：旧做法的节点里要持有它的shared_ptr
+struct Conn {
+    int closed;
+    Conn() : closed(0) {}
+};
+
+// 原来的TimerManager：每次刷新new一个节点压进堆，旧节点只标记删除，到期时才弹出
+class HeapTimerManager {
+public:
+    struct Node {
+        Node(const std::shared_ptr<Conn> &c, int64_t exp) : deleted(false), expiredTime(exp), conn(c) {}
+        bool deleted;
+        int64_t expiredTime;
+        std::shared_ptr<Conn> conn;
+    };
+    typedef std::shared_ptr<Node> SPNode;
+    struct Cmp {
+        bool operator()(const SPNode &a, const SPNode &b) const { return a->expiredTime > b->expiredTime; }
+    };
+
+    SPNode addTimer(const std::shared_ptr<Conn> &conn, int64_t expiredTime) {
+        SPNode node(new Node(conn, expiredTime));
+        queue_.push(node);
+        return node;
+    }
+    void expireUntil(int64_t now) {
+        while (!queue_.empty()) {
+            SPNode node = queue_.top();
+            if (!node->deleted && node->expiredTime > now) break;
+            queue_.pop();
+            if (!node->deleted) node->conn->closed++;
+        }
+    }
+    size_t size() const { return queue_.size(); }
+
+private:
+    std::priority_queue<SPNode, std::deque<SPNode>, Cmp> queue_;
+};
+
+// 同一组超时时间：2s的连接超时和150s的keep-alive超时混在一起，再加一点抖动
+int timeoutOf(int i) { return (i % 4 == 0 ? 2000 : 150000) + (i * 7919) % 1000; }
+
+void benchHeap(int n, int rounds) {
+    HeapTimerManager manager;
+    std::vector<std::shared_ptr<Conn>> conns(n);
+    std::vector<HeapTimerManager::SPNode> timers(n);
+    for (int i = 0; i < n; ++i) conns[i].reset(new Conn);
+
+    int64_t now = 0;
+    double start = nowSeconds();
+    for (int i = 0; i < n; ++i) timers[i] = manager.addTimer(conns[i], now + timeoutOf(i));
+    double inserted = nowSeconds();
+    for (int r = 0; r < rounds; ++r) {
+        now += 1;
+        for (int i = 0; i < n; ++i) {
+            timers[i]->deleted = true;
+            timers[i]->conn.reset();
+            timers[i] = manager.addTimer(conns[i], now + timeoutOf(i));
+        }
+    }
+    double refreshed = nowSeconds();
+    size_t peak = manager.size();
+    timers.clear();
+    // 每次走1ms，和loop里每轮推进一样
+    for (int64_t t = now; manager.size() > 0; ++t) manager.expireUntil(t);
+    double expired = nowSeconds();
+
+    int closed = 0;
+    for (int i = 0; i < n; ++i) closed += conns[i]->closed;
+    printf("priority_queue: insert %.1f ns, refresh %.1f ns, expire %.1f ns per timer; peak queue %zu, closed %d\n",
+           (inserted - start) * 1e9 / n, (refreshed - inserted) * 1e9 / (static_cast<double>(n) * rounds),
+           (expired - refreshed) * 1e9 / n, peak, closed);
+}
+
+void benchWheel(int n, int rounds) {
+    TimerManager manager;
+    std::vector<Conn> conns(n);
+    std::vector<TimerNode> timers(n);
+    for (int i = 0; i < n; ++i) {
+        Conn *c = &conns[i];
+        timers[i].setCallback([c]() { c->closed++; });
+    }
+
+    // 时间轮的起点是构造时的单调时钟，这里从那里开始推进
+    int64_t base = CachedClock::nowMs();
+    int64_t now = base;
+    double start = nowSeconds();
+    for (int i = 0; i < n; ++i) manager.addTimerAt(&timers[i], now + timeoutOf(i));
+    double inserted = nowSeconds();
+    for (int r = 0; r < rounds; ++r) {
+        now += 1;
+        manager.expireUntil(now);
+        for (int i = 0; i < n; ++i) manager.addTimerAt(&timers[i], now + timeoutOf(i));
+    }
+    double refreshed = nowSeconds();
+    int64_t last = now;
+    for (int i = 0; i < n; ++i)
+        if (timers[i].getExpTime() > last) last = timers[i].getExpTime();
+    for (int64_t t = now; t <= last; ++t) manager.expireUntil(t);
+    double expired = nowSeconds();
+
+    int closed = 0, linked = 0;
+    for (int i = 0; i < n; ++i) {
+        closed += conns[i].closed;
+        if (timers[i].isLinked()) ++linked;
+        // 到期时间之前不能触发
+    }
+    printf("timing wheel:   insert %.1f ns, refresh %.1f ns, expire %.1f ns per timer; nodes %d, closed %d, still linked %d\n",
+           (inserted - start) * 1e9 / n, (refreshed - inserted) * 1e9 / (static_cast<double>(n) * rounds),
+           (expired - refreshed) * 1e9 / n, n, closed, linked);
+}
+
+// 检查每个定时器恰好在到期的那一毫秒触发
+bool checkWheel() {
+    TimerManager manager;
+    const int n = 20000;
+    int64_t base = CachedClock::nowMs();
+    std::vector<int64_t> fired(n, -1);
+    std::vector<TimerNode> timers(n);
+    int64_t now = base;
+    for (int i = 0; i < n; ++i) {
+        int64_t *slot = &fired[i];
+        int64_t *clock = &now;
+        timers[i].setCallback([slot, clock]() { *slot = *clock; });
+        // 覆盖各层：几毫秒到几小时
+        int64_t timeout = (static_cast<int64_t>(i) * 104729) % (i % 3 == 0 ? 300 : i % 3 == 1 ? 200000 : 30000000);
+        manager.addTimerAt(&timers[i], base + timeout);
+    }
+    int64_t last = base;
+    for (int i = 0; i < n; ++i)
+        if (timers[i].getExpTime() > last) last = timers[i].getExpTime();
+    // 步长不一，模拟loop每轮之间隔的时间不同
+    const int kMaxStep = 37;
+    while (now < last) {
+        now += 1 + now % kMaxStep;
+        manager.expireUntil(now);
+    }
+    for (int i = 0; i < n; ++i) {
+        if (fired[i] < timers[i].getExpTime() || fired[i] > timers[i].getExpTime() + kMaxStep) {
+            printf("timer %d expires at %lld, fired at %lld\n", i, (long long)(timers[i].getExpTime() - base),
+                   (long long)(fired[i] - base));
+            return false;
+        }
+    }
+    return true;
+}
+
+// loop按nextExpiration()决定epoll_wait等多久：只在它给出的时间点推进，每个定时器也要恰好按时触发
+bool checkNextExpiration() {
+    TimerManager manager;
+    const int n = 5000;
+    int64_t base = CachedClock::nowMs();
+    int64_t now = base;
+    std::vector<int64_t> fired(n, -1);
+    std::vector<TimerNode> timers(n);
+    for (int i = 0; i < n; ++i) {
+        int64_t *slot = &fired[i];
+        int64_t *clock = &now;
+        timers[i].setCallback([slot, clock]() { *slot = *clock; });
+        int64_t timeout = (static_cast<int64_t>(i) * 7727) % (i % 2 ? 1000 : 3000000);
+        manager.addTimerAt(&timers[i], base + timeout);
+    }
+    int64_t next;
+    while ((next = manager.nextExpiration()) >= 0) {
+        if (next < now) return false;
+        for (int i = 0; i < n; ++i)
+            if (timers[i].isLinked() && timers[i].getExpTime() < next) return false;
+        now = next;
+        manager.expireUntil(now);
+    }
+    for (int i = 0; i < n; ++i)
+        if (fired[i] != timers[i].getExpTime()) return false;
+    return true;
+}
+
+// 通用定时器：一次性、重复、在自己的回调里取消、取消还没到期的
+bool checkSchedule() {
+    TimerManager manager;
+    int64_t now = CachedClock::nowMs();
+    int once = 0, every = 0, cancelled = 0;
+    manager.schedule(now + 100, 0, 1, [&once]() { ++once; });
+    manager.schedule(now + 10, 10, 2, [&every, &manager]() {
+        if (++every == 5) manager.cancel(2);
+    });
+    manager.schedule(now + 50, 0, 3, [&cancelled]() { ++cancelled; });
+    manager.cancel(3);
+    manager.expireUntil(now + 1000);
+    // 取消已经结束的定时器什么也不做
+    manager.cancel(1);
+    return once == 1 && every == 5 && cancelled == 0 && manager.nextExpiration() < 0;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    bool wheel = checkWheel();
+    printf("check: %s\n", wheel ? "ok" : "FAILED");
+    bool next = checkNextExpiration();
+    printf("check nextExpiration: %s\n", next ? "ok" : "FAILED");
+    bool schedule = checkSchedule();
+    printf("check schedule: %s\n", schedule ? "ok" : "FAILED");
+    printf("%d timers, %d refresh rounds\n", n, rounds);
+    benchHeap(n, rounds);
+    benchWheel(n, rounds);
+    // 性能数字只是参考，正确性检查有一项没通过就返回非0
+    return wheel && next && schedule ? 0 : 1;
+}